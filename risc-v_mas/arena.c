@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ARENA_ALIGN (sizeof(max_align_t))
+
+struct arena_chunk {
+  struct arena_chunk *next;
+  size_t size;
+  size_t used;
+  max_align_t data[];
+};
+
+/* Private Helpers */
+
+static struct arena_chunk *new_chunk(struct arena *a, size_t min)
+{
+  struct arena_chunk *c;
+  size_t size = a->chunk_size;
+
+  while (size < min) size *= 2;
+
+  c = malloc(sizeof(struct arena_chunk) + size);
+  if (!c) return NULL;
+
+  c->next = a->head;
+  c->size = size;
+  c->used = 0;
+  a->head = c;
+
+  /* Grow geometrically so the number of chunks stays logarithmic */
+  a->chunk_size = 2*size;
+  return c;
+}
+
+/* Public Interface */
+
+void arena_init(struct arena *a, size_t chunk_size)
+{
+  a->head = NULL;
+  a->chunk_size = chunk_size ? chunk_size : 4096;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+  struct arena_chunk *c = a->head;
+  void *p;
+
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+  if (!c || c->size - c->used < size) {
+    c = new_chunk(a, size);
+    if (!c) return NULL;
+  }
+
+  p = (char*)c->data + c->used;
+  c->used += size;
+  return p;
+}
+
+void arena_reset(struct arena *a)
+{
+  struct arena_chunk *c = a->head;
+
+  if (!c) return;
+
+  while (c->next) {
+    struct arena_chunk *next = c->next->next;
+    free(c->next);
+    c->next = next;
+  }
+  c->used = 0;
+}
+
+void arena_free(struct arena *a)
+{
+  struct arena_chunk *c = a->head, *next;
+
+  while (c != NULL) {
+    next = c->next;
+    free(c);
+    c = next;
+  }
+  a->head = NULL;
+}
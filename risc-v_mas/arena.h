@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+struct arena_chunk;
+
+/**
+ * Bump allocator for objects that all share one lifetime.
+ *
+ * Allocations are carved sequentially out of large chunks, so objects that
+ * are allocated one after another are laid out one after another in memory.
+ * Nothing is freed individually: the whole arena is released at once.
+ */
+struct arena {
+  struct arena_chunk *head;  /* chunk currently being carved */
+  size_t chunk_size;         /* size of the next chunk to allocate */
+};
+
+/**
+ * Initializes @a to allocate in chunks of at least @chunk_size bytes.
+ */
+void arena_init(struct arena *a, size_t chunk_size);
+
+/**
+ * Returns @size bytes of uninitialized memory from @a, aligned for any type.
+ *
+ * Returns NULL if out of memory.
+ */
+void *arena_alloc(struct arena *a, size_t size);
+
+/**
+ * Makes all the memory of @a available again, keeping only the most recent
+ * chunk so that a steady-state user of the arena stops calling malloc.
+ */
+void arena_reset(struct arena *a);
+
+/**
+ * Frees all the memory owned by @a.
+ */
+void arena_free(struct arena *a);
+
+#endif /* ARENA_H_ */
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "decode.h"
+
+#include <stddef.h>
+
+/* Private Helpers */
+
+/* The encoding of each instruction, from mnemonics.def */
+struct insn_encoding {
+  uint8_t op;
+  uint8_t format;
+  uint8_t opcode;
+  uint8_t funct3;
+  uint8_t funct7;
+};
+
+static const struct insn_encoding encodings[] = {
+#define DIRECTIVE(t, name)
+#define INSTRUCTION(t, name, fmt, op, f3, f7, ops) \
+  { INSN_##t, FMT_##fmt, op, f3, f7 },
+#define PSEUDO(t, name, ...)
+#include "mnemonics.def"
+#undef DIRECTIVE
+#undef INSTRUCTION
+#undef PSEUDO
+};
+
+static const char *const insn_names[NUM_INSN_OPS] = {
+  "unknown",
+#define DIRECTIVE(t, name)
+#define INSTRUCTION(t, name, ...) name,
+#define PSEUDO(t, name, ...)
+#include "mnemonics.def"
+#undef DIRECTIVE
+#undef INSTRUCTION
+#undef PSEUDO
+};
+
+/*
+ * The second level is indexed by funct3 and by which of the two funct7 values
+ * of RV32I the word holds, 0x00, 0x20 or neither.
+ */
+#define FUNCT7_KINDS (3)
+#define SUBOPS (8 * FUNCT7_KINDS)
+
+static unsigned subop(uint32_t word)
+{
+  uint8_t funct7 = word >> 25;
+  unsigned kind = funct7 == 0 ? 0 : funct7 == 0x20 ? 1 : 2;
+
+  return kind * 8 + ((word >> 12) & 0x7);
+}
+
+/* Indexed by opcode, then subop(); INSN_UNKNOWN where nothing matches */
+static uint8_t decode_table[128][SUBOPS];
+
+/*
+ * funct7 only tells instructions apart in the R format and in the shift
+ * immediates. ecall must be 0 outside its opcode, which decode_insn checks.
+ */
+static int funct7_matters(const struct insn_encoding *e)
+{
+  return e->format == FMT_R || e->opcode == 0x73 ||
+         (e->opcode == 0x13 && (e->funct3 == 0x1 || e->funct3 == 0x5));
+}
+
+/* Fills decode_table before main, so that lookups need no locking */
+__attribute__((constructor))
+static void build_decode_table(void)
+{
+  const struct insn_encoding *e;
+  unsigned kind, funct3;
+
+  for (e = encodings; e < encodings + sizeof(encodings)/sizeof(*e); e++) {
+    for (kind = 0; kind < FUNCT7_KINDS; kind++) {
+      if (funct7_matters(e) && kind != (e->funct7 == 0 ? 0U : 1U)) continue;
+      for (funct3 = 0; funct3 < 8; funct3++) {
+        /* U and UJ immediates take up the funct3 bits */
+        if (e->format != FMT_U && e->format != FMT_UJ && funct3 != e->funct3) {
+          continue;
+        }
+        decode_table[e->opcode][kind * 8 + funct3] = e->op;
+      }
+    }
+  }
+}
+
+static int32_t imm_i(uint32_t w)
+{
+  return (int32_t)w >> 20;
+}
+
+static int32_t imm_s(uint32_t w)
+{
+  return ((int32_t)w >> 25 << 5) | ((w >> 7) & 0x1f);
+}
+
+static int32_t imm_sb(uint32_t w)
+{
+  return ((int32_t)(w & 0x80000000) >> 19) | ((w & 0x80) << 4) |
+         ((w >> 20) & 0x7e0) | ((w >> 7) & 0x1e);
+}
+
+static int32_t imm_u(uint32_t w)
+{
+  return (int32_t)(w & 0xfffff000);
+}
+
+static int32_t imm_uj(uint32_t w)
+{
+  return ((int32_t)(w & 0x80000000) >> 11) | (w & 0xff000) |
+         ((w >> 9) & 0x800) | ((w >> 20) & 0x7fe);
+}
+
+/* Public Interface */
+
+struct decoded_insn decode_insn(uint32_t word)
+{
+  struct decoded_insn d = { 0 };
+  uint8_t rd = (word >> 7) & 0x1f;
+  uint8_t rs1 = (word >> 15) & 0x1f;
+  uint8_t rs2 = (word >> 20) & 0x1f;
+
+  d.op = decode_table[word & 0x7f][subop(word)];
+  if (d.op == INSN_ECALL && word != 0x73) d.op = INSN_UNKNOWN;
+  if (d.op == INSN_UNKNOWN) return d;
+  d.format = encodings[d.op - 1].format;
+
+  switch (d.format) {
+    case FMT_R:
+      d.rd = rd;
+      d.rs1 = rs1;
+      d.rs2 = rs2;
+      break;
+    case FMT_I:
+      d.rd = rd;
+      d.rs1 = rs1;
+      /* Shift amounts leave funct7 out; ecall is all zeros anyway */
+      d.imm = funct7_matters(&encodings[d.op - 1]) ? rs2 : imm_i(word);
+      break;
+    case FMT_S:
+      d.rs1 = rs1;
+      d.rs2 = rs2;
+      d.imm = imm_s(word);
+      break;
+    case FMT_SB:
+      d.rs1 = rs1;
+      d.rs2 = rs2;
+      d.imm = imm_sb(word);
+      break;
+    case FMT_U:
+      d.rd = rd;
+      d.imm = imm_u(word);
+      break;
+    case FMT_UJ:
+      d.rd = rd;
+      d.imm = imm_uj(word);
+      break;
+  }
+  return d;
+}
+
+const char *insn_name(uint8_t op)
+{
+  return op < NUM_INSN_OPS ? insn_names[op] : insn_names[INSN_UNKNOWN];
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DECODE_H_
+#define DECODE_H_
+
+#include <stdint.h>
+
+/* Instruction formats of the RV32I subset */
+enum insn_format {
+  FMT_R,
+  FMT_I,
+  FMT_S,
+  FMT_SB,
+  FMT_U,
+  FMT_UJ
+};
+
+/* Instructions the decoder recognizes, in mnemonics.def order */
+enum insn_op {
+  INSN_UNKNOWN,
+#define DIRECTIVE(t, name)
+#define INSTRUCTION(t, name, ...) INSN_##t,
+#define PSEUDO(t, name, ...)
+#include "mnemonics.def"
+#undef DIRECTIVE
+#undef INSTRUCTION
+#undef PSEUDO
+  NUM_INSN_OPS
+};
+
+/*
+ * An instruction word taken apart. Registers that the format does not have
+ * are 0. The immediate is sign-extended and in bytes: the byte offset of a
+ * branch or jump, the value loaded by lui (low 12 bits clear), or the shift
+ * amount of a shift immediate.
+ */
+struct decoded_insn {
+  uint8_t op;         /* enum insn_op */
+  uint8_t format;     /* enum insn_format */
+  uint8_t rd;
+  uint8_t rs1;
+  uint8_t rs2;
+  int32_t imm;
+};
+
+/**
+ * Decodes the instruction @word. Words that are not one of the instructions
+ * of mnemonics.def decode to INSN_UNKNOWN, with all fields 0.
+ */
+struct decoded_insn decode_insn(uint32_t word);
+
+/**
+ * Returns the mnemonic of @op, or "unknown".
+ */
+const char *insn_name(uint8_t op);
+
+#endif /* DECODE_H_ */
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ELF32_H_
+#define ELF32_H_
+
+/*
+ * The parts of the ELF32 format that mas writes: a little-endian RISC-V
+ * executable with one loadable segment per assembler segment.
+ *
+ *   struct elf32_ehdr
+ *   struct elf32_phdr[2]            (text, then data)
+ *   text contents                   (at a page-aligned offset)
+ *   data contents                   (at a page-aligned offset)
+ *   .symtab, .strtab, .shstrtab
+ *   struct elf32_shdr[ELF_NSECTIONS]
+ *
+ * Unlike an .mxe image, data words are in memory order, so a word is
+ * little-endian like any other RISC-V ELF file.
+ */
+
+#include <stdint.h>
+
+#define ELF_MAGIC "\177ELF"
+#define ELF_CLASS32 (1)
+#define ELF_DATA2LSB (1)
+#define ELF_VERSION (1)
+#define ELF_ET_EXEC (2)
+#define ELF_EM_RISCV (243)
+
+/* Loadable segments start at a page boundary in the file and in memory */
+#define ELF_PAGE_SIZE (0x1000)
+
+struct elf32_ehdr {
+  uint8_t ident[16];      /* ELF_MAGIC, class, data, version, then zeros */
+  uint16_t type;          /* ELF_ET_EXEC */
+  uint16_t machine;       /* ELF_EM_RISCV */
+  uint32_t version;       /* ELF_VERSION */
+  uint32_t entry;         /* Address of the first instruction to run */
+  uint32_t phoff;         /* File offset of the program headers */
+  uint32_t shoff;         /* File offset of the section headers */
+  uint32_t flags;         /* 0: no compressed instructions, soft float */
+  uint16_t ehsize;        /* sizeof(struct elf32_ehdr) */
+  uint16_t phentsize;     /* sizeof(struct elf32_phdr) */
+  uint16_t phnum;
+  uint16_t shentsize;     /* sizeof(struct elf32_shdr) */
+  uint16_t shnum;
+  uint16_t shstrndx;      /* Index of the section holding section names */
+};
+
+enum elf32_ptype {
+  ELF_PT_LOAD = 1,
+};
+
+enum elf32_pflags {
+  ELF_PF_X = 1,
+  ELF_PF_W = 2,
+  ELF_PF_R = 4,
+};
+
+struct elf32_phdr {
+  uint32_t type;          /* enum elf32_ptype */
+  uint32_t offset;        /* File offset of the contents */
+  uint32_t vaddr;         /* Load address */
+  uint32_t paddr;         /* Same as vaddr */
+  uint32_t filesz;        /* Bytes of contents in the file */
+  uint32_t memsz;         /* Bytes in memory, zero past filesz */
+  uint32_t flags;         /* enum elf32_pflags */
+  uint32_t align;         /* ELF_PAGE_SIZE */
+};
+
+/* Sections of the executable, in the order of their headers */
+enum elf32_section {
+  ELF_SEC_NULL,
+  ELF_SEC_TEXT,
+  ELF_SEC_DATA,
+  ELF_SEC_SYMTAB,
+  ELF_SEC_STRTAB,
+  ELF_SEC_SHSTRTAB,
+  ELF_NSECTIONS
+};
+
+enum elf32_stype {
+  ELF_SHT_PROGBITS = 1,
+  ELF_SHT_SYMTAB = 2,
+  ELF_SHT_STRTAB = 3,
+};
+
+enum elf32_sflags {
+  ELF_SHF_WRITE = 1,
+  ELF_SHF_ALLOC = 2,
+  ELF_SHF_EXECINSTR = 4,
+};
+
+struct elf32_shdr {
+  uint32_t name;          /* Offset of the name in the .shstrtab section */
+  uint32_t type;          /* enum elf32_stype */
+  uint32_t flags;         /* enum elf32_sflags */
+  uint32_t addr;          /* Load address, 0 if not loaded */
+  uint32_t offset;        /* File offset of the contents */
+  uint32_t size;          /* Bytes of contents */
+  uint32_t link;          /* .symtab: index of its string table */
+  uint32_t info;          /* .symtab: index of the first global symbol */
+  uint32_t addralign;
+  uint32_t entsize;       /* .symtab: sizeof(struct elf32_sym) */
+};
+
+/* Symbol info: binding in the upper 4 bits, type in the lower 4 */
+#define ELF_STB_GLOBAL (1)
+#define ELF_STT_OBJECT (1)
+#define ELF_STT_FUNC (2)
+#define ELF_ST_INFO(bind, type) (((bind) << 4) | (type))
+
+struct elf32_sym {
+  uint32_t name;          /* Offset of the name in the .strtab section */
+  uint32_t value;         /* Address of the label */
+  uint32_t size;          /* 0: labels have no extent */
+  uint8_t info;           /* ELF_ST_INFO(binding, type) */
+  uint8_t other;          /* 0 */
+  uint16_t shndx;         /* enum elf32_section the label is in */
+};
+
+#endif /* ELF32_H_ */
@@ -26,882 +26,990 @@
  */
 
 #include "encode.h"
+#include "decode.h"
+#include "diag.h"
 #include "parser.h"
+#include "regs.h"
 #include "symtab.h"
 #include "writer.h"
 
 #include <assert.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 //#define DEBUG 1
 
-void encode_data(struct line *data_start, uint8_t *data)
+/* Operand lists of the instructions, in source order */
+enum operand_shape {
+  OPS_NONE,           /* ecall */
+  OPS_RD_RS1_RS2,     /* add rd, rs1, rs2 */
+  OPS_RD_RS1_IMM,     /* addi rd, rs1, imm  or  lw rd, imm(rs1) */
+  OPS_RS2_MEM,        /* sw rs2, imm(rs1) */
+  OPS_RS1_RS2_LABEL,  /* beq rs1, rs2, label */
+  OPS_RD_IMM,         /* lui rd, imm */
+  OPS_RD_LABEL        /* jal rd, label */
+};
+
+#define OPERANDS_NONE (0)
+#define OPERANDS_RD_RS1_RS2 (3)
+#define OPERANDS_RD_RS1_IMM (3)
+#define OPERANDS_RS2_MEM (2)
+#define OPERANDS_RS1_RS2_LABEL (3)
+#define OPERANDS_RD_IMM (2)
+#define OPERANDS_RD_LABEL (2)
+
+/* Everything the encoder needs to know about one kind of line */
+struct insn_desc {
+  uint8_t format;     /* enum insn_format */
+  uint8_t opcode;
+  uint8_t funct3;
+  uint8_t funct7;
+  uint8_t shape;      /* enum operand_shape */
+  uint8_t operands;   /* number of source operands */
+  uint8_t bytes;      /* size of the encoding in the text segment */
+};
+
+static const struct insn_desc insn_table[NUM_LINETYPES] = {
+#define DIRECTIVE(t, name)
+#define INSTRUCTION(t, name, fmt, op, f3, f7, ops) \
+  [t] = { FMT_##fmt, op, f3, f7, OPS_##ops, OPERANDS_##ops, 4 },
+#define PSEUDO(t, name, nops, nbytes) \
+  [t] = { .operands = nops, .bytes = nbytes },
+#include "mnemonics.def"
+#undef DIRECTIVE
+#undef INSTRUCTION
+#undef PSEUDO
+};
+
+/* Operand fields of one instruction. Branch and jump offsets are in imm. */
+struct operands {
+  uint8_t rd;
+  uint8_t rs1;
+  uint8_t rs2;
+  int32_t imm;
+};
+
+/* Encoder-owned segment buffers start at this size and double */
+#define MIN_SEGMENT_CAP (4096)
+
+/* Largest .align, as a power of two */
+#define MAX_ALIGN (12)
+
+/* Largest .fill element, in bytes */
+#define MAX_FILL_SIZE (4)
+
+/* A use of a label ahead of its definition, waiting to be patched */
+struct fixup {
+  uint32_t next;      /* 1-based index of the next fixup on the list */
+  uint32_t offset;    /* Offset of the instruction in the text segment */
+  linetype type;      /* BEQ, BNE, JAL or LA */
+  struct operands o;  /* Operands other than the label offset */
+  const char *label;  /* Label waited for, NULL if the slot is free */
+};
+
+/**
+ * Makes room in @segment of @enc for the bytes up to offset @end, growing an
+ * encoder-owned buffer if needed. Overrunning the segment is reported once.
+ *
+ * Returns 0 if the bytes do not fit in the segment.
+ */
+static int reserve(struct encoder *enc, linetype segment, uint32_t end)
 {
-  struct line *curr = data_start;
-  uint32_t offset = 0x10000000;
-  uint32_t addr = 0;
-  struct token_node *tok;
-  int n;
-  char *c;
-  int i;
-
-  assert(curr->type == DATA);
-
-  while (curr != NULL) {
-    if (curr->label) {
-      curr->label[strlen(curr->label)-1] = 0;
-      symtab_add(curr->label, addr+offset);
-    }
-
-    switch (curr->type) {
-      case ALIGN:
-        n = atoi(curr->token_listhead->next->token);
-        uint32_t next_addr = ((addr + (1<<n)-1) & ~((1<<n)-1));
-        while (addr != next_addr) data[addr++] = 0;
-        break;
-
-      case ASCIIZ:
-        c = curr->token_listhead->next->token;
-        assert(*c++ == '"');
-        while (*c != '"') {
-          data[addr+3] = *c++;
-          if (*c == '"') {
-            data[addr+2] = data[addr+1] = data[addr] = 0;
-            addr += 4;
-            break;
-          }
-          data[addr+2] = *c++;
-          if (*c == '"') {
-            data[addr+1] = data[addr] = 0;
-            addr += 4;
-            break;
-          }
-          data[addr+1] = *c++;
-          if (*c == '"') {
-            data[addr] = 0;
-            addr += 4;
-            break;
-          }
-          data[addr] = *c++;
-          addr += 4;
-          if (*c == '"') {
-            data[addr++] = 0;
-            break;
-          }
-        }
-        while (addr%4 != 0) data[addr++] = 0; /* pad with 0s */
-        break;
-
-      case DATA:
-        break;
-
-      case SPACE:
-        n = atoi(curr->token_listhead->next->token);
-        for (i = 0; i < n; i++) {
-          data[addr++] = 0;
-        }
-        break;
-
-      case TEXT:
-        curr = NULL;
-        goto out;
-
-      case WORD:
-        tok = curr->token_listhead->next;
-        while (tok != NULL) {
-          uint32_t w = (uint32_t)atoi(tok->token);
-          /* swap bytes, store in big endian, will be written in little */
-          data[addr++] = (w >> 24) & 0xff;
-          data[addr++] = (w >> 16) & 0xff;
-          data[addr++] = (w >> 8) & 0xff;
-          data[addr++] = w & 0xff;
-          tok = tok->next;
-        }
-        break;
-
-      default:
-        fprintf(stderr, "Unexpected directive: type = %d\n", curr->type);
-        goto out;
-    }
-#if defined(DEBUG)
-    printf("Directive: %d\n", curr->type);
-    if (curr->label) {
-      printf("%s\t", curr->label);
+  uint8_t **buf = segment == DATA ? &enc->data : &enc->text;
+  uint32_t *cap = segment == DATA ? &enc->data_cap : &enc->text_cap;
+  uint32_t max = segment == DATA ? enc->data_max : enc->text_max;
+  uint32_t newcap;
+  uint8_t *grown;
+
+  if (end <= *cap) return 1;
+
+  if (end <= max && enc->owns_buffers) {
+    newcap = *cap ? *cap : MIN_SEGMENT_CAP;
+    while (newcap < end) newcap = newcap > max / 2 ? max : 2 * newcap;
+    grown = realloc(*buf, newcap);
+    if (grown) {
+      *buf = grown;
+      *cap = newcap;
+      return 1;
     }
-    for (tok = curr->token_listhead; tok != NULL; tok = tok->next) {
-      printf("%s\t", tok->token);
-    }
-    printf("\n");
-#endif
-    curr = curr->next;
   }
 
-out:
-  if (addr >= 4096) {
-    fprintf(stderr, "Data segment overrun, size = %d\n", addr);
+  if (!(enc->overrun & (1 << segment))) {
+    diag_error(enc->diag, "%s segment overrun, size > %u",
+        segment == DATA ? "Data" : "Text", end <= max ? *cap : max);
+    enc->overrun |= 1 << segment;
   }
+  return 0;
+}
 
-  /* zero-initialize the remainder */
-  while (addr < 4*DATA_SEGMENT_WORDS) {
-    data[addr++] = 0;
+static int32_t get_imm(char *s)
+{
+  int32_t rv = 0;
+  int i;
+  if (s && s[0] == '0') {
+    if (s[1] == 'x') {
+      sscanf(s, "0x%x", &rv);
+      return rv;
+    } else if (s[1] == 'b') {
+      for (i = 2; s[i] == '0' || s[i] == '1'; i++) {
+        rv = (rv << 1) | (s[i]-'0');
+      }
+      return rv;
+    }
   }
+  return (int32_t)atoi(s);
 }
 
-void encode_text_first_pass(struct line *text_start, uint8_t *text)
+/* Returns where the .asciiz of @len characters starting at @addr ends */
+static uint32_t asciiz_end(uint32_t addr, uint32_t len)
 {
-  struct line *curr = text_start;
-  uint32_t offset = 0x00400000;
-  uint32_t addr = 0;
-
-  assert(curr->type == TEXT);
-
-  while (curr != NULL) {
-    if (curr->label != NULL) {
-      curr->label[strlen(curr->label)-1] = 0;
-      symtab_add(curr->label, addr+offset);
-    }
+  /* Characters go in groups of 4, then a NUL if the last group is full */
+  if (len == 0) return (addr + 3) & ~3;
+  if (len % 4 == 0) return (addr + len + 1 + 3) & ~3;
+  return (addr + 4*((len + 3) / 4) + 3) & ~3;
+}
 
-    if (curr->type == TEXT) {
-      curr = curr->next;
-      continue;
-    }
+/**
+ * Finds the offset @end that the data directive @curr ends at.
+ *
+ * Returns 0 if the directive is invalid.
+ */
+static int data_end(struct encoder *enc, struct line *curr, uint32_t *end)
+{
+  uint32_t addr = enc->data_addr;
+  char *close;
+  int n, size;
+
+  switch (curr->type) {
+    case ALIGN:
+      n = atoi(curr->tokens[1].token);
+      if (n < 0 || n > MAX_ALIGN) {
+        diag_error(enc->diag, "Bad alignment: %s", curr->tokens[1].token);
+        return 0;
+      }
+      *end = (addr + (1<<n)-1) & ~((1<<n)-1);
+      return 1;
 
-    if (curr->type >= NUM_DIRECTIVES) {
-      addr += 4;
-    } else {
-      break; /* found something that is not an instruction */
-    }
+    case ASCIIZ:
+      close = memchr(curr->tokens[1].token + 1, '"', curr->tokens[1].len - 1);
+      if (curr->tokens[1].token[0] != '"' || !close) {
+        diag_error(enc->diag, "Unterminated string: %s", curr->tokens[1].token);
+        return 0;
+      }
+      *end = asciiz_end(addr, close - curr->tokens[1].token - 1);
+      return 1;
+
+    case FILL:
+      if (curr->ntokens > 4) break;
+      n = atoi(curr->tokens[1].token);
+      size = curr->ntokens > 2 ? atoi(curr->tokens[2].token) : 1;
+      if (n < 0) {
+        diag_error(enc->diag, "Bad repeat count: %s", curr->tokens[1].token);
+        return 0;
+      }
+      if (size != 1 && size != 2 && size != MAX_FILL_SIZE) {
+        diag_error(enc->diag, "Bad fill size: %s", curr->tokens[2].token);
+        return 0;
+      }
+      if ((uint64_t)n * size > UINT32_MAX - 3 - addr) {
+        diag_error(enc->diag, "Fill too large: %s", curr->tokens[1].token);
+        return 0;
+      }
+      /* Padded to a word, like .asciiz */
+      *end = n ? (addr + n*size + 3) & ~3 : addr;
+      return 1;
+
+    case SPACE:
+    case ZERO:
+      n = atoi(curr->tokens[1].token);
+      if (n < 0) {
+        diag_error(enc->diag, "Bad size: %s", curr->tokens[1].token);
+        return 0;
+      }
+      *end = addr + n;
+      return 1;
 
-#if defined(DEBUG)
-    printf("Type: %d\n", curr->type);
-    if (curr->label) {
-      printf("%s\t", curr->label);
-    }
-    for (tok = curr->token_listhead; tok != NULL; tok = tok->next) {
-      printf("%s\t", tok->token);
-    }
-    printf("\n");
-#endif
+    case WORD:
+      *end = addr + 4*(curr->ntokens - 1);
+      return 1;
 
-    curr = curr->next;
+    default:
+      diag_error(enc->diag, "Unexpected directive: type = %d", curr->type);
+      return 0;
   }
+  diag_error(enc->diag, "Wrong number of operands for %s: %u",
+      curr->tokens[0].token, curr->ntokens - 1);
+  return 0;
 }
 
-static uint8_t get_opcode(struct line *insn)
+/* Parses a decimal integer like atoi does, wrapping around on overflow */
+static uint32_t parse_int(const char *s)
 {
-  linetype t = insn->type;
-  uint8_t op = 0xff;
-
-  switch (t) {
-    case LW:
-      op = 0x03;
-      break;
-
-    case ADDI:
-    case SLLI:
-    case SLTI:
-    case XORI:
-    case SRLI:
-    case SRAI:
-    case ORI:
-    case ANDI:
-      op = 0x13;
-      break;
-
-    case AUIPC:
-      op = 0x17;
-      break;
-
-    case SW:
-      op = 0x23;
-      break;
+  uint32_t n = 0;
+  int neg = 0;
 
-    case ADD:
-    case SUB:
-    case SLL:
-    case XOR:
-    case SRL:
-    case SRA:
-    case OR:
-    case AND:
-      op = 0x33;
-      break;
+  while (*s == ' ' || (*s >= '\t' && *s <= '\r')) s++;
+  if (*s == '-' || *s == '+') neg = *s++ == '-';
+  while ((unsigned char)(*s - '0') < 10) n = 10*n + (*s++ - '0');
+  return neg ? -n : n;
+}
 
-    case LUI:
-      op = 0x37;
-      break;
+/* Reverses the bytes of each of the @nwords 4-byte groups at @p */
+static void swap_words(uint8_t *p, uint32_t nwords)
+{
+  uint32_t w;
+
+  /* memcpy keeps unaligned groups legal; each one compiles to a bswap */
+  while (nwords--) {
+    memcpy(&w, p, 4);
+    w = __builtin_bswap32(w);
+    memcpy(p, &w, 4);
+    p += 4;
+  }
+}
 
-    case BEQ:
-    case BNE:
-      op = 0x63;
-      break;
+/**
+ * Stores the @n bytes at @src at data offset @addr, then zeros up to the next
+ * word. Data words are kept reversed, so memory byte a lives at offset a ^ 3.
+ */
+static void store_bytes(uint8_t *data, uint32_t addr, const uint8_t *src,
+                        uint32_t n)
+{
+  uint32_t end = addr + n, bulk;
+
+  while (addr % 4 && addr < end) data[addr++ ^ 3] = *src++;
+  bulk = (end - addr) & ~3;
+  memcpy(data + addr, src, bulk);
+  swap_words(data + addr, bulk / 4);
+  addr += bulk;
+  src += bulk;
+  while (addr < end) data[addr++ ^ 3] = *src++;
+  while (addr % 4) data[addr++ ^ 3] = 0;
+}
 
-    case JALR:
-      op = 0x67;
-      break;
+/**
+ * Copies the file named by the .incbin @curr into the data segment.
+ *
+ * The operands are the path, optionally quoted, then an optional number of
+ * bytes to skip and an optional number of bytes to include. The file is mapped
+ * rather than read, so the bytes are copied once, straight into place. Like
+ * .asciiz, the bytes are padded with zeros to a word.
+ */
+static void encode_incbin(struct encoder *enc, struct line *curr)
+{
+  const struct token *path = &curr->tokens[1];
+  char name[FILENAME_MAX];
+  uint32_t addr = enc->data_addr, end;
+  struct stat st;
+  void *map;
+  off_t skip = 0, count;
+  int fd;
+
+  if (curr->ntokens > 4) {
+    diag_error(enc->diag, "Wrong number of operands for %s: %u",
+        curr->tokens[0].token, curr->ntokens - 1);
+    return;
+  }
+  if (path->token[0] == '"') {
+    if (path->len < 2 || path->token[path->len - 1] != '"') {
+      diag_error(enc->diag, "Unterminated string: %s", path->token);
+      return;
+    }
+    snprintf(name, sizeof(name), "%.*s", (int)path->len - 2, path->token + 1);
+  } else {
+    snprintf(name, sizeof(name), "%s", path->token);
+  }
 
-    case JAL:
-      op = 0x6F;
-      break;
+  fd = open(name, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    diag_error(enc->diag, "Unable to open %s", name);
+    if (fd >= 0) close(fd);
+    return;
+  }
 
-    case ECALL:
-      op = 0x73;
-      break;
+  if (curr->ntokens > 2) skip = atoi(curr->tokens[2].token);
+  count = st.st_size - skip;
+  if (curr->ntokens > 3) count = atoi(curr->tokens[3].token);
+  if (skip < 0 || skip > st.st_size || count < 0 || count > st.st_size - skip
+      || count > UINT32_MAX - 3 - addr) {
+    diag_error(enc->diag, "Bad range for %s: %lld bytes at %lld of %lld",
+        name, (long long)count, (long long)skip, (long long)st.st_size);
+    close(fd);
+    return;
+  }
 
-    default:
-      fprintf(stderr, "get_opcode: Unknown instruction type: %d\n", t);
-      break;
+  end = (addr + count + 3) & ~3;
+  if (count > 0 && reserve(enc, DATA, end)) {
+    map = mmap(NULL, skip + count, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      diag_error(enc->diag, "Unable to map %s", name);
+    } else {
+      madvise(map, skip + count, MADV_SEQUENTIAL);
+      store_bytes(enc->data, addr, (uint8_t*)map + skip, count);
+      munmap(map, skip + count);
+    }
   }
+  close(fd);
 
-  return op;
+  /* Keep laying out past an overrun, like the other data directives */
+  enc->data_addr = count > 0 ? end : addr;
 }
 
-static uint8_t get_funct3(struct line *insn)
+/* Emits the data directive @curr at the end of the data segment */
+static void encode_data(struct encoder *enc, struct line *curr)
 {
-  linetype t = insn->type;
-  uint8_t f3 = 0xff;
+  uint32_t addr = enc->data_addr;
+  uint32_t end, len, w;
+  uint8_t *data;
+  struct token *tok;
+  char *str;
+  int n, size;
+
+  if (curr->ntokens < 2 && curr->type != WORD) {
+    diag_error(enc->diag, "Wrong number of operands for %s: %u",
+        curr->tokens[0].token, curr->ntokens - 1);
+    return;
+  }
 
-  switch (t) {
-    case ADD:
-    case ADDI:
-    case SUB:
-    case BEQ:
-    case JALR:
-    case ECALL:
-      f3 = 0x0;
-      break;
+  if (curr->type == INCBIN) {
+    encode_incbin(enc, curr);
+    return;
+  }
 
-    case SLL:
-    case SLLI:
-    case BNE:
-      f3 = 0x1;
-      break;
+  if (!data_end(enc, curr, &end)) return;
+  if (!reserve(enc, DATA, end)) {
+    /* Keep laying out, so that later labels stay where they belong */
+    enc->data_addr = end;
+    return;
+  }
+  data = enc->data;
 
-    case LW:
-    case SW:
-    case SLT:
-    case SLTI:
-      f3 = 0x2;
+  switch (curr->type) {
+    case ALIGN:
+      n = atoi(curr->tokens[1].token);
+      if ((1U<<n) > enc->data_align) enc->data_align = 1U<<n;
+      memset(data + addr, 0, end - addr);
       break;
 
-    case XOR:
-    case XORI:
-      f3 = 0x4;
+    case ASCIIZ:
+      /* Characters are stored 4 at a time, reversed within each group.
+       * Copy them, clear the partial group, the NUL and the padding, then
+       * swap every group in place. */
+      str = curr->tokens[1].token + 1;
+      len = (char*)memchr(str, '"', curr->tokens[1].len - 1) - str;
+      memcpy(data + addr, str, len);
+      memset(data + addr + len, 0, end - addr - len);
+      swap_words(data + addr, (len + 3) / 4);
       break;
 
-    case SRL:
-    case SRLI:
-    case SRA:
-    case SRAI:
-      f3 = 0x5;
+    case FILL:
+      /* Elements go in memory order, little-endian like a .word */
+      n = atoi(curr->tokens[1].token);
+      size = curr->ntokens > 2 ? atoi(curr->tokens[2].token) : 1;
+      w = curr->ntokens > 3 ? get_imm(curr->tokens[3].token) : 0;
+      for (len = 0; len < (uint32_t)n*size; len++, addr++) {
+        data[addr ^ 3] = w >> 8*(len % size);
+      }
+      for (; addr < end; addr++) data[addr ^ 3] = 0;
       break;
 
-    case OR:
-    case ORI:
-      f3 = 0x6;
+    case SPACE:
+    case ZERO:
+      memset(data + addr, 0, end - addr);
       break;
 
-    case AND:
-    case ANDI:
-      f3 = 0x7;
+    case WORD:
+      /* Words are stored big-endian, will be written in little */
+      for (tok = &curr->tokens[1]; tok < curr->tokens + curr->ntokens; tok++) {
+        w = __builtin_bswap32(parse_int(tok->token));
+        memcpy(data + addr, &w, 4);
+        addr += 4;
+      }
       break;
 
     default:
-      fprintf(stderr, "get_funct3: Unknown instruction type: %d\n", t);
       break;
   }
+#if defined(DEBUG)
+  printf("Directive: %d\n", curr->type);
+  if (curr->label) {
+    printf("%s\t", curr->label);
+  }
+  for (tok = curr->tokens; tok < curr->tokens + curr->ntokens; tok++) {
+    printf("%s\t", tok->token);
+  }
+  printf("\n");
+#endif
 
-  return f3;
+  enc->data_addr = end;
 }
 
-static uint8_t get_funct7(struct line *insn)
+static uint8_t get_reg(struct encoder *enc, char *name, uint32_t len)
 {
-  linetype t = insn->type;
-  uint8_t f7 = 0xff;
-
-  switch (t) {
-    case ADD:
-    case AND:
-    case OR:
-    case SLL:
-    case SLLI:
-    case SLT:
-    case SRL:
-    case XOR:
-    case ECALL:
-      f7 = 0x0;
-      break;
+  int reg = reg_lookup(name, len);
 
-    case SRA:
-    case SRAI:
-    case SUB:
-      f7 = 0x20;
-      break;
-
-    default:
-      fprintf(stderr, "get_funct7: Unknown instruction type: %d\n", t);
-      break;
+  if (reg < 0) {
+    diag_error(enc->diag, "get_reg: unknown name: %.*s", (int)len, name);
+    return 0;
   }
+  return reg;
+}
 
-  return f7;
-}
-
-uint8_t get_reg(char *name)
-{
-  char *regnames[] = {
-    "zero",
-    "ra",
-    "sp",
-    "gp",
-    "tp",
-    "t0",
-    "t1",
-    "t2",
-    "s0",
-    "s1",
-    "a0",
-    "a1",
-    "a2",
-    "a3",
-    "a4",
-    "a5",
-    "a6",
-    "a7",
-    "s2",
-    "s3",
-    "s4",
-    "s5",
-    "s6",
-    "s7",
-    "s8",
-    "s9",
-    "s10",
-    "s11",
-    "t3",
-    "t4",
-    "t5",
-    "t6"
-  };
-  int i;
-
-  if (name[0] == 'x') return (uint8_t)atoi(&name[1]);
-  if (strncmp(name, "fp", 2) == 0) return 8;
+static uint32_t encode_r_fmt(const struct insn_desc *d, const struct operands *o)
+{
+  return (d->funct7 << 25) | (o->rs2 << 20) | (o->rs1 << 15) |
+         (d->funct3 << 12) | (o->rd << 7) | d->opcode;
+}
 
-  for (i = 0; i < 31; i++) {
-    if (strncmp(name, regnames[i], 4) == 0) return i;
-  }
+static uint32_t encode_i_fmt(const struct insn_desc *d, const struct operands *o)
+{
+  uint32_t imm = (o->imm & 0xfff) | (d->funct7 << 5);
 
-  fprintf(stderr, "get_reg: unknown name: %s\n", name);
-  return 0;
+  return (imm << 20) | (o->rs1 << 15) | (d->funct3 << 12) | (o->rd << 7) |
+         d->opcode;
 }
 
-static uint32_t encode_r_fmt(struct line *insn, uint32_t pc)
+static uint32_t encode_s_fmt(const struct insn_desc *d, const struct operands *o)
 {
-  struct token_node *tok;
-  uint32_t iw = 0;
-  uint8_t rs1, rs2, rd, funct7, funct3, opcode;
+  uint32_t imm = o->imm;
 
-  tok = insn->token_listhead->next;
-  rd = get_reg(tok->token);
-  tok = tok->next;
-  rs1 = get_reg(tok->token);
-  tok = tok->next;
-  rs2 = get_reg(tok->token);
-  tok = tok->next;
-  assert(tok == NULL);
-
-  funct7 = get_funct7(insn);
-  funct3 = get_funct3(insn);
-  opcode = get_opcode(insn);
+  return (((imm >> 5) & 0x7f) << 25) | (o->rs2 << 20) | (o->rs1 << 15) |
+         (d->funct3 << 12) | ((imm & 0x1f) << 7) | d->opcode;
+}
 
-  iw = (funct7<<25) | (rs2<<20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+static uint32_t encode_sb_fmt(const struct insn_desc *d, const struct operands *o)
+{
+  uint32_t imm = o->imm;
 
-  return iw;
+  return (((imm >> 12) & 0x1) << 31) | (((imm >> 5) & 0x3f) << 25) |
+         (o->rs2 << 20) | (o->rs1 << 15) | (d->funct3 << 12) |
+         (((imm >> 1) & 0xf) << 8) | (((imm >> 11) & 0x1) << 7) | d->opcode;
 }
 
-static int32_t get_imm(char *s)
+static uint32_t encode_u_fmt(const struct insn_desc *d, const struct operands *o)
 {
-  int32_t rv = 0;
-  int i;
-  if (s && s[0] == '0') {
-    if (s[1] == 'x') {
-      sscanf(s, "0x%x", &rv);
-      return rv;
-    } else if (s[1] == 'b') {
-      int len = strlen(s);
-      for (i = 2; i < len; i++) {
-        uint32_t b = s[i]-'0';
-        rv += b<<(len-i-1);
-      }
-      return rv;
-    }
-  }
-  return (int32_t)atoi(s);
+  return (o->imm & ~(0xfffU)) | (o->rd << 7) | d->opcode;
 }
 
-static uint32_t encode_i_fmt(struct line *insn, uint32_t pc)
+static uint32_t encode_uj_fmt(const struct insn_desc *d, const struct operands *o)
 {
-  struct token_node *tok;
-  uint32_t iw = 0;
-  uint8_t rs1, rd, funct3, opcode;
-  int16_t imm = 0;
+  uint32_t imm = o->imm;
 
-  tok = insn->token_listhead->next;
-  rd = get_reg(tok->token);
-  tok = tok->next;
+  return (((imm >> 20) & 0x1) << 31) | (((imm >> 1) & 0x3ff) << 21) |
+         (((imm >> 11) & 0x1) << 20) | (((imm >> 12) & 0xff) << 12) |
+         (o->rd << 7) | d->opcode;
+}
 
-  if (tok->token[strlen(tok->token)-1] == ')') {
-    char *d = strdup(tok->token);
-    char *off = d;
-    char *base = d;
-    while (*++base != '(');
-    *base++ = 0;
-    base[strlen(base)-1] = 0;
-    rs1 = get_reg(base);
-    imm = get_imm(off);
-    free(d);
-  } else {
-    rs1 = get_reg(tok->token);
-    tok = tok->next;
-    imm = get_imm(tok->token);
-  }
-  tok = tok->next;
-  assert(tok == NULL);
+static uint32_t (*const format_encoders[])(const struct insn_desc *,
+                                           const struct operands *) = {
+  [FMT_R] = encode_r_fmt,
+  [FMT_I] = encode_i_fmt,
+  [FMT_S] = encode_s_fmt,
+  [FMT_SB] = encode_sb_fmt,
+  [FMT_U] = encode_u_fmt,
+  [FMT_UJ] = encode_uj_fmt
+};
+
+static uint32_t encode_fields(linetype t, const struct operands *o)
+{
+  const struct insn_desc *d = &insn_table[t];
 
+  return format_encoders[d->format](d, o);
+}
 
-  if (insn->type == SLLI || insn->type == SRLI || insn->type == SRAI) {
-    imm |= get_funct7(insn)<<5;
-  }
+/* Returns 1 if @tok has the form of a memory operand imm(reg) */
+static int is_mem_operand(const struct token *tok)
+{
+  return tok->len > 0 && memchr(tok->token, '(', tok->len)
+         && tok->token[tok->len-1] == ')';
+}
+
+/* Parses a memory operand imm(reg). Returns 0 if @tok is not one. */
+static int get_mem_operand(struct encoder *enc, struct token *tok,
+                           int32_t *imm, uint8_t *reg)
+{
+  char *base;
 
-  funct3 = get_funct3(insn);
-  opcode = get_opcode(insn);
+  if (!is_mem_operand(tok)) return 0;
 
-  iw = (imm<<20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
-  return iw;
+  base = (char*)memchr(tok->token, '(', tok->len) + 1;
+  *reg = get_reg(enc, base, tok->token + tok->len - 1 - base);
+  *imm = get_imm(tok->token);
+  return 1;
 }
 
-static uint32_t encode_env(struct line *insn, uint32_t pc)
+/* Names what a label is used as by an instruction of @type */
+static const char *label_use(linetype type)
 {
-  uint32_t iw = 0;
-  uint8_t rs1, rd, funct3, opcode;
-  uint16_t imm;
-  assert(insn->type == ECALL);
-  rs1 = rd = 0;
-  funct3 = get_funct3(insn);
-  opcode = get_opcode(insn);
-  imm = get_funct7(insn)<<5;
-  iw = (imm<<20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
-  return iw;
+  switch (type) {
+    case BEQ:
+    case BNE:
+      return "branch target";
+    case JAL:
+      return "jump target";
+    default:
+      return "address";
+  }
 }
 
-static uint32_t encode_sb_fmt(struct line *insn, uint32_t pc)
+/**
+ * Queues a fixup for the instruction of @type at @pc, which uses the
+ * undefined @label. Returns 0 if it could not be queued.
+ */
+static int add_fixup(struct encoder *enc, char *label, linetype type,
+                     uint32_t pc, const struct operands *o)
 {
-  struct token_node *tok;
-  uint32_t iw = 0;
-  uint8_t rs1, rs2, funct3, opcode;
-  int16_t imm = 0;
-  uint32_t branch_target = 0;
+  struct fixup *f;
+  uint32_t *pending;
+  const char *name;
+  uint32_t idx;
 
-  tok = insn->token_listhead->next;
-  rs1 = get_reg(tok->token);
-  tok = tok->next;
-  rs2 = get_reg(tok->token);
-  tok = tok->next;
-  branch_target = symtab_find_address(tok->token);
-  if (!branch_target) {
-    fprintf(stderr, "Unable to find branch target: %s\n", tok->token);
-    return 0;
+  pending = symtab_pending(enc->symtab, label, &name);
+  if (!pending) return 0;
+
+  if (enc->free_fixup) {
+    idx = enc->free_fixup;
+    enc->free_fixup = enc->fixups[idx-1].next;
+  } else {
+    if (enc->nfixups == enc->maxfixups) {
+      uint32_t max = enc->maxfixups ? 2*enc->maxfixups : 64;
+      f = realloc(enc->fixups, max * sizeof(struct fixup));
+      if (!f) return 0;
+      enc->fixups = f;
+      enc->maxfixups = max;
+    }
+    idx = ++enc->nfixups;
   }
-  tok = tok->next;
-  assert(tok == NULL);
 
-  funct3 = get_funct3(insn);
-  opcode = get_opcode(insn);
+  f = &enc->fixups[idx-1];
+  f->offset = pc - enc->text_base;
+  f->type = type;
+  f->o = *o;
+  f->label = name;
+  f->next = *pending;
+  *pending = idx;
+  return 1;
+}
 
-  imm = (int32_t)branch_target - (int32_t)pc;
+/**
+ * Finds the offset from @pc to @label and stores it in @o, which holds the
+ * other operands of the instruction of @type. In a single pass, a label that
+ * is not defined yet gets a fixup instead.
+ *
+ * Returns 0 if @label cannot be resolved.
+ */
+static int get_label_offset(struct encoder *enc, char *label, linetype type,
+                            uint32_t pc, struct operands *o)
+{
+  uint32_t target;
 
-  iw = ((((imm&(1<<12))>>6)|((imm&0x7e0)>>5))<<25)
-        | (rs2 << 20)
-        | (rs1 << 15)
-        | (funct3 << 12)
-        | (((imm&0x1e)|((imm&(1<<11))>>11))<<7)
-        | opcode;
+  if (symtab_find(enc->symtab, label, &target) ||
+      (enc->globals && symtab_find(enc->globals, label, &target))) {
+    o->imm = (int32_t)target - (int32_t)pc;
+    return 1;
+  }
+  if (enc->one_pass && add_fixup(enc, label, type, pc, o)) {
+    return 1;
+  }
 
-  return iw;
+  diag_error(enc->diag, "Unable to find %s: %s", label_use(type), label);
+  return 0;
 }
 
-static uint32_t encode_u_fmt(struct line *insn, uint32_t pc)
+static int check_operand_count(struct encoder *enc, struct line *insn)
 {
-  struct token_node *tok;
-  uint32_t iw = 0;
-  uint8_t rd, opcode;
-  int32_t imm = 0;
-
-  tok = insn->token_listhead->next;
-  rd = get_reg(tok->token);
-  tok = tok->next;
-  imm = get_imm(tok->token);
-  tok = tok->next;
-  assert(tok == NULL);
-
-  opcode = get_opcode(insn);
- 
-  iw = (imm&~(0xfffU)) | (rd<<7) | opcode;
+  const struct insn_desc *d = &insn_table[insn->type];
+  uint32_t n = insn->ntokens - 1;
+
+  if (n == d->operands) return 1;
+  /* imm(rs1) stands for the last two operands */
+  if (insn->type < FIRST_PSEUDOINST && d->shape == OPS_RD_RS1_IMM &&
+      n == d->operands - 1 && is_mem_operand(&insn->tokens[2])) {
+    return 1;
+  }
 
-  return iw;
+  diag_error(enc->diag, "Wrong number of operands for %s: %u",
+      insn->tokens[0].token, n);
+  return 0;
 }
 
-static uint32_t encode_uj_fmt(struct line *insn, uint32_t pc)
+/* Fills @o from the source operands of @insn, located at @pc. */
+static int get_operands(struct encoder *enc, struct line *insn, uint32_t pc,
+                        struct operands *o)
 {
-  struct token_node *tok;
-  uint32_t iw = 0;
-  uint8_t rd, opcode;
-  int32_t imm = 0;
-  uint32_t jump_target;
+  struct token *tok = &insn->tokens[1];
 
-  tok = insn->token_listhead->next;
-  rd = get_reg(tok->token);
-  tok = tok->next;
-  jump_target = symtab_find_address(tok->token);
-  if (!jump_target) {
-    fprintf(stderr, "Unable to find jump target: %s\n", tok->token);
-    return 0;
-  }
-  tok = tok->next;
-  assert(tok == NULL);
+  switch (insn_table[insn->type].shape) {
+    case OPS_NONE:
+      break;
 
-  opcode = get_opcode(insn);
+    case OPS_RD_RS1_RS2:
+      o->rd = get_reg(enc, tok[0].token, tok[0].len);
+      o->rs1 = get_reg(enc, tok[1].token, tok[1].len);
+      o->rs2 = get_reg(enc, tok[2].token, tok[2].len);
+      break;
 
-  imm = (int32_t)jump_target - (int32_t)pc;
+    case OPS_RD_RS1_IMM:
+      o->rd = get_reg(enc, tok[0].token, tok[0].len);
+      if (!get_mem_operand(enc, &tok[1], &o->imm, &o->rs1)) {
+        o->rs1 = get_reg(enc, tok[1].token, tok[1].len);
+        o->imm = get_imm(tok[2].token);
+      }
+      break;
+
+    case OPS_RS2_MEM:
+      o->rs2 = get_reg(enc, tok[0].token, tok[0].len);
+      if (!get_mem_operand(enc, &tok[1], &o->imm, &o->rs1)) {
+        diag_error(enc->diag, "Unrecognized memory operand: %s",
+            tok[1].token);
+        return 0;
+      }
+      break;
+
+    case OPS_RS1_RS2_LABEL:
+      o->rs1 = get_reg(enc, tok[0].token, tok[0].len);
+      o->rs2 = get_reg(enc, tok[1].token, tok[1].len);
+      if (!get_label_offset(enc, tok[2].token, insn->type, pc, o)) {
+        return 0;
+      }
+      break;
 
-  iw = ((imm&(1<<20))|((imm&0x7fe)<<8)|((imm&(1<<11))>>4)|((imm&0xff000)>>12))<<12
-        | (rd<<7) | opcode;
+    case OPS_RD_IMM:
+      o->rd = get_reg(enc, tok[0].token, tok[0].len);
+      o->imm = get_imm(tok[1].token);
+      break;
 
-  return iw;
+    case OPS_RD_LABEL:
+      o->rd = get_reg(enc, tok[0].token, tok[0].len);
+      if (!get_label_offset(enc, tok[1].token, insn->type, pc, o)) {
+        return 0;
+      }
+      break;
+  }
 
-  return 0;
+  return 1;
 }
 
-static uint32_t encode_s_fmt(struct line *insn, uint32_t pc)
+static uint32_t encode_insn(struct encoder *enc, struct line *insn, uint32_t pc)
 {
-  struct token_node *tok;
-  uint32_t iw = 0;
-  uint8_t rs1, rs2, funct3, opcode;
-  int16_t imm = 0;
-
-  tok = insn->token_listhead->next;
-  rs2 = get_reg(tok->token);
-  tok = tok->next;
+  struct operands o = {0};
 
-  if (tok->token[strlen(tok->token)-1] == ')') {
-    char *off = tok->token;
-    char *base = tok->token;
-    while (*++base != '(');
-    *base++ = 0;
-    base[strlen(base)-1] = 0;
-    rs1 = get_reg(base);
-    imm = get_imm(off);
-  } else {
-    fprintf(stderr, "Unrecognized memory operand: %s\n", tok->token);
+  if (!check_operand_count(enc, insn) || !get_operands(enc, insn, pc, &o)) {
     return 0;
   }
-  tok = tok->next;
-  assert(tok == NULL);
-
-  funct3 = get_funct3(insn);
-  opcode = get_opcode(insn);
+  return encode_fields(insn->type, &o);
+}
 
-  iw = ((imm&~(0x1f))<<20) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) |
-       ((imm&0x1f)<<7) | opcode;
+/**
+ * Encodes the pair @hi, addi that loads the 32-bit @imm into @rd. addi
+ * sign-extends its immediate, so @hi rounds the upper bits to compensate.
+ */
+static void encode_hi_lo(linetype hi, uint8_t rd, int32_t imm, uint32_t *iw)
+{
+  struct operands o = { .rd = rd, .rs1 = rd };
 
-  return iw;
+  o.imm = imm + 0x800;
+  iw[0] = encode_fields(hi, &o);
+  o.imm = imm;
+  iw[1] = encode_fields(ADDI, &o);
 }
 
-
-static uint32_t encode_insn(struct line *insn, uint32_t pc)
+static uint32_t encode_pseudo_insn(struct encoder *enc, struct line *insn,
+                                   uint32_t pc, uint8_t *text)
 {
+  uint32_t *iw = (uint32_t*)text;
+  struct token *tok = &insn->tokens[1];
+  struct operands o = {0};
+
+  memset(text, 0, insn_table[insn->type].bytes);
+  if (!check_operand_count(enc, insn)) {
+    return insn_table[insn->type].bytes;
+  }
 
   switch (insn->type) {
-    case ADD:
-    case AND:
-    case OR:
-    case SLL:
-    case SLT:
-    case SRA:
-    case SRL:
-    case SUB:
-    case XOR:
-      return encode_r_fmt(insn, pc);
+    case J:
+      if (!get_label_offset(enc, tok[0].token, JAL, pc, &o)) break;
+      *iw = encode_fields(JAL, &o);
       break;
 
-    case ADDI:
-    case ANDI:
-    case JALR:
-    case LW:
-    case ORI:
-    case SLLI:
-    case SLTI:
-    case SRAI:
-    case SRLI:
-    case XORI:
-      return encode_i_fmt(insn, pc);
+    case LA:
+      o.rd = get_reg(enc, tok[0].token, tok[0].len);
+      if (!get_label_offset(enc, tok[1].token, LA, pc, &o)) break;
+      encode_hi_lo(AUIPC, o.rd, o.imm, iw);
       break;
 
-    case ECALL:
-      return encode_env(insn, pc);
+    case LI:
+      encode_hi_lo(LUI, get_reg(enc, tok[0].token, tok[0].len),
+                   get_imm(tok[1].token), iw);
       break;
 
-    case AUIPC:
-    case LUI:
-      return encode_u_fmt(insn, pc);
+    case MV:
+      o.rd = get_reg(enc, tok[0].token, tok[0].len);
+      o.rs1 = get_reg(enc, tok[1].token, tok[1].len);
+      *iw = encode_fields(ADDI, &o);
       break;
 
-    case BEQ:
-    case BNE:
-      return encode_sb_fmt(insn, pc);
+    case NEG:
+      o.rd = get_reg(enc, tok[0].token, tok[0].len);
+      o.rs2 = get_reg(enc, tok[1].token, tok[1].len);
+      *iw = encode_fields(SUB, &o);
       break;
 
-    case JAL:
-      return encode_uj_fmt(insn, pc);
+    case NOP:
+      *iw = encode_fields(ADDI, &o);
+      break;
+
+    case NOT:
+      o.rd = get_reg(enc, tok[0].token, tok[0].len);
+      o.rs1 = get_reg(enc, tok[1].token, tok[1].len);
+      o.imm = -1;
+      *iw = encode_fields(XORI, &o);
       break;
 
-    case SW:
-      return encode_s_fmt(insn, pc);
+    case RET:
+      o.rs1 = 1; /* ra */
+      *iw = encode_fields(JALR, &o);
       break;
 
     default:
-      fprintf(stderr, "Unknown instruction type: %d\n", insn->type);
+      diag_error(enc->diag, "Unrecognized pseudo instruction type: %d",
+          insn->type);
       break;
   }
-  return 0;
+
+  return insn_table[insn->type].bytes;
 }
 
-static uint32_t encode_pseudo_insn(struct line *insn, uint32_t offset, uint32_t addr, char *text)
+/* Re-encodes the instruction waiting in @f now that its label is at @addr */
+static void patch_fixup(struct encoder *enc, struct fixup *f, uint32_t addr)
 {
-  uint32_t iw = 0;
-  struct token_node *tok;
-  struct token_node tok1, tok2, tok3, tok4;
-  uint32_t address;
-  uint32_t imm_long;
-  uint16_t imm_short;
-  uint8_t rd, rs1, rs2;
-  uint8_t opcode, funct3, funct7;
-  struct line real_insn = {};
+  uint32_t *iw;
 
-  tok = insn->token_listhead->next;
+  /* The instruction was dropped if it overran the segment */
+  if (f->offset + insn_table[f->type].bytes > enc->text_cap) return;
 
-  switch (insn->type) {
-    case J:
-      real_insn.type = JAL;
-      tok1.token = "jal";
-      tok2.token = "x0";
-      tok3.token = tok->token;
-      tok1.next = &tok2;
-      tok2.next = &tok3;
-      tok3.next = NULL;
-      real_insn.token_listhead = &tok1;
-      iw = encode_uj_fmt(&real_insn, offset+addr);
-      *((uint32_t*)text) = iw;
-      return 4;
+  iw = (uint32_t*)(enc->text + f->offset);
+  f->o.imm = (int32_t)addr - (int32_t)(enc->text_base + f->offset);
+  if (f->type == LA) {
+    encode_hi_lo(AUIPC, f->o.rd, f->o.imm, iw);
+  } else {
+    *iw = encode_fields(f->type, &f->o);
+  }
+}
 
-    case LA:
-      /* This one is a bit sketchy. Not fully tested yet. */
-      rd = get_reg(tok->token);
-      tok = tok->next;
-      address = symtab_find_address(tok->token);
-      if (!address) {
-        fprintf(stderr, "Unable to find address: %s\n", tok->token);
-        return 0;
-      }
-      tok = tok->next;
-      assert(tok == NULL);
-      imm_long = (int32_t)address - (int32_t)(addr+offset);
-
-      imm_short = imm_long & 0xfff;
-      imm_long >>= 12;
-      if (imm_short & 1<<11) {
-        imm_long++;
-      }
+/* Defines @label at the current position and patches its pending uses */
+static void define_label(struct encoder *enc, char *label)
+{
+  uint32_t addr, pending, next;
+  struct fixup *f;
 
-      real_insn.type = AUIPC;
-      opcode = get_opcode(&real_insn);
-      iw = (imm_long<<12) | (rd<<7) | opcode;
-      *((uint32_t*)text) = iw;
-      text += 4;
+  if (enc->segment == DATA) {
+    addr = enc->data_base + enc->data_addr;
+  } else {
+    addr = enc->text_base + enc->text_addr;
+  }
 
-      real_insn.type = ADDI;
-      rs1 = rd;
-      opcode = get_opcode(&real_insn);
-      funct3 = get_funct3(&real_insn);
-      iw = (imm_short<<20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
-      *((uint32_t*)text) = iw;
+  if (symtab_add(enc->symtab, label, addr, &pending) != 0) {
+    diag_error(enc->diag, "Duplicate label: %s", label);
+    return;
+  }
 
-      return 8;
+  while (pending) {
+    f = &enc->fixups[pending-1];
+    next = f->next;
+    patch_fixup(enc, f, addr);
+    f->label = NULL;
+    f->next = enc->free_fixup;
+    enc->free_fixup = pending;
+    pending = next;
+  }
+}
 
-    case LI:
-      rd = get_reg(tok->token);
-      tok = tok->next;
-      imm_long = get_imm(tok->token);
-      tok = tok->next;
-      assert(tok == NULL);
-
-      imm_short = imm_long & 0xfff;
-      imm_long >>= 12;
-      if (imm_short & 1<<11) {
-        imm_long++;
-      }
+/* Encodes the instruction @curr at the end of the text segment */
+static void encode_text(struct encoder *enc, struct line *curr)
+{
+  uint32_t pc = enc->text_base + enc->text_addr;
+  uint8_t *text;
 
-      real_insn.type = LUI;
-      opcode = get_opcode(&real_insn);
-      iw = (imm_long<<12) | (rd<<7) | opcode;
-      *((uint32_t*)text) = iw;
-      text += 4;
+  if (!reserve(enc, TEXT, enc->text_addr + insn_table[curr->type].bytes)) {
+    enc->text_addr += insn_table[curr->type].bytes;
+    return;
+  }
+  text = enc->text + enc->text_addr;
 
-      real_insn.type = ADDI;
-      rs1 = rd;
-      opcode = get_opcode(&real_insn);
-      funct3 = get_funct3(&real_insn);
-      iw = (imm_short<<20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
-      *((uint32_t*)text) = iw;
+  if (curr->type < FIRST_PSEUDOINST) {
+    *((uint32_t*)text) = encode_insn(enc, curr, pc);
+  } else {
+    /* handle pseudoinstructions specially. */
+    encode_pseudo_insn(enc, curr, pc, text);
+  }
+  enc->text_addr += insn_table[curr->type].bytes;
+}
 
-      return 8;
+/* Makes the labels named by the .globl line @curr visible to other files */
+static void export_labels(struct encoder *enc, struct line *curr)
+{
+  struct token *tok;
 
-    case MV:
-      real_insn.type = ADDI;
-      tok1.token = "addi";
-      tok2.token = tok->token;
-      tok = tok->next;
-      tok3.token = tok->token;
-      tok4.token = "0";
-      tok1.next = &tok2;
-      tok2.next = &tok3;
-      tok3.next = &tok4;
-      tok4.next = NULL;
-      real_insn.token_listhead = &tok1;
-      iw = encode_i_fmt(&real_insn, offset+addr);
-      *((uint32_t*)text) = iw;
-      return 4;
+  for (tok = &curr->tokens[1]; tok < curr->tokens + curr->ntokens; tok++) {
+    if (symtab_export(enc->symtab, tok->token) != 0) {
+      diag_error(enc->diag, "Unable to export label: %s", tok->token);
+    }
+  }
+}
 
-    case NEG:
-      real_insn.type = SUB;
-      tok1.token = "sub";
-      tok2.token = tok->token;
-      tok = tok->next;
-      tok3.token = "x0";
-      tok4.token = tok->token;
-      tok1.next = &tok2;
-      tok2.next = &tok3;
-      tok3.next = &tok4;
-      tok4.next = NULL;
-      real_insn.token_listhead = &tok1;
-      iw = encode_r_fmt(&real_insn, offset+addr);
-      *((uint32_t*)text) = iw;
-      return 4;
+/**
+ * Switches segments, defines the label of @curr and lays the line out in its
+ * segment. Data is always emitted; instructions only if @emit_text is set,
+ * otherwise just their size is accounted for.
+ */
+static void assemble_line(struct encoder *enc, struct line *curr,
+                          int emit_text)
+{
+  if (curr->type == DATA || curr->type == TEXT) {
+    enc->segment = curr->type;
+  }
 
-    case NOP:
-      real_insn.type = ADDI;
-      tok1.token = "addi";
-      tok2.token = "x0";
-      tok3.token = "x0";
-      tok4.token = "0";
-      tok1.next = &tok2;
-      tok2.next = &tok3;
-      tok3.next = &tok4;
-      tok4.next = NULL;
-      real_insn.token_listhead = &tok1;
-      iw = encode_i_fmt(&real_insn, offset+addr);
-      *((uint32_t*)text) = iw;
-      return 4;
+  if (curr->label) {
+    define_label(enc, curr->label);
+  }
 
-    case NOT:
-      real_insn.type = XORI;
-      tok1.token = "xori";
-      tok2.token = tok->token;
-      tok = tok->next;
-      tok3.token = tok->token;
-      tok4.token = "-1";
-      tok1.next = &tok2;
-      tok2.next = &tok3;
-      tok3.next = &tok4;
-      tok4.next = NULL;
-      real_insn.token_listhead = &tok1;
-      iw = encode_i_fmt(&real_insn, offset+addr);
-      *((uint32_t*)text) = iw;
-      return 4;
+  if (curr->type == DATA || curr->type == TEXT) {
+    return;
+  }
 
-    case RET:
-      real_insn.type = JALR;
-      tok1.token = "jalr";
-      tok2.token = "x0";
-      tok3.token = "0(ra)";
-      tok1.next = &tok2;
-      tok2.next = &tok3;
-      tok3.next = NULL;
-      real_insn.token_listhead = &tok1;
-      iw = encode_i_fmt(&real_insn, offset+addr);
-      *((uint32_t*)text) = iw;
-      return 4;
+  if (curr->type == GLOBL) {
+    export_labels(enc, curr);
+    return;
+  }
 
-    default:
-      fprintf(stderr, "Unrecognized pseudo instruction type: %d\n", insn->type);
-      break;
+  if (enc->segment == DATA) {
+    if (curr->type < NUM_DIRECTIVES) {
+      encode_data(enc, curr);
+    } else {
+      diag_error(enc->diag, "Instruction in .data segment: %s",
+          curr->tokens[0].token);
+    }
+  } else if (curr->type < NUM_DIRECTIVES) {
+    diag_error(enc->diag, "Directive in .text segment: %s",
+        curr->tokens[0].token);
+  } else if (emit_text) {
+    encode_text(enc, curr);
+  } else {
+    enc->text_addr += insn_table[curr->type].bytes;
+    if (enc->text_addr > enc->text_max) reserve(enc, TEXT, enc->text_addr);
   }
+}
 
-  return 0;
+void encoder_init(struct encoder *enc, struct symtab *symtab,
+                  uint32_t data_max, uint32_t text_max)
+{
+  memset(enc, 0, sizeof(struct encoder));
+  enc->symtab = symtab;
+  enc->data_max = data_max;
+  enc->text_max = text_max;
+  enc->owns_buffers = 1;
+  enc->data_base = DATA_BEGIN;
+  enc->text_base = TEXT_BEGIN;
+  enc->data_align = 4;
+  enc->segment = TEXT;
+  enc->one_pass = 1;
 }
 
+void encoder_init_fixed(struct encoder *enc, struct symtab *symtab,
+                        uint8_t *data, uint32_t data_size, uint8_t *text,
+                        uint32_t text_size)
+{
+  encoder_init(enc, symtab, data_size, text_size);
+  enc->owns_buffers = 0;
+  enc->data = data;
+  enc->data_cap = data_size;
+  enc->text = text;
+  enc->text_cap = text_size;
+}
 
-void encode_text_second_pass(struct line *text_start, uint8_t *text)
+int encoder_reserve(struct encoder *enc, linetype segment, uint32_t end)
 {
-  struct line *curr;
-  uint32_t offset = 0x00400000;
-  uint32_t addr = 0;
-  uint32_t iw;
+  return reserve(enc, segment, end);
+}
 
-  assert(text_start->type == TEXT);
+void encoder_free(struct encoder *enc)
+{
+  if (enc->owns_buffers) {
+    free(enc->data);
+    free(enc->text);
+  }
+  enc->data = enc->text = NULL;
+  enc->data_cap = enc->text_cap = 0;
+}
 
-  for (curr = text_start; curr != NULL; curr = curr->next) {
-    if (curr->type == TEXT) {
-      continue;
-    }
-    
-    if (curr->type < NUM_DIRECTIVES) {
-      break; /* found something that is not an instruction */
-    }
+void encode_line(struct encoder *enc, struct line *l)
+{
+  assemble_line(enc, l, 1);
+}
 
-    if (curr->type < FIRST_PSEUDOINST) {
-      iw = encode_insn(curr, offset+addr);
-      *((uint32_t*)text) = iw;
-      text += 4;
-      addr += 4;
-    } else {
-      /* handle pseudoinstructions specially. */
-      uint8_t bytes = encode_pseudo_insn(curr, offset, addr, text);
-      text += bytes;
-      addr += bytes;
+void encoder_finish(struct encoder *enc)
+{
+  uint32_t i;
+
+  for (i = 0; i < enc->nfixups; i++) {
+    struct fixup *f = &enc->fixups[i];
+    if (f->label) {
+      diag_error(enc->diag, "Unable to find %s: %s", label_use(f->type),
+          f->label);
+      if (f->offset + insn_table[f->type].bytes <= enc->text_cap) {
+        memset(enc->text + f->offset, 0, insn_table[f->type].bytes);
+      }
     }
   }
+  free(enc->fixups);
+  enc->fixups = NULL;
+  enc->nfixups = enc->maxfixups = enc->free_fixup = 0;
+
+  /* zero-initialize the remainder */
+  if (enc->data_addr < enc->data_cap) {
+    memset(enc->data + enc->data_addr, 0, enc->data_cap - enc->data_addr);
+  }
+  if (enc->text_addr < enc->text_cap) {
+    memset(enc->text + enc->text_addr, 0, enc->text_cap - enc->text_addr);
+  }
 }
 
-void encode(struct line *llh, uint8_t *data, uint8_t *text)
+void encode_layout(struct encoder *enc, struct program *prog)
 {
-  struct line *curr = llh;
-  struct line *text_start = NULL;
+  struct line *curr;
 
-  while (curr != NULL) {
-    if (curr->type == DATA) {
-      encode_data(curr, data);
-    }
-    if (curr->type == TEXT) {
-      text_start = curr;
-      encode_text_first_pass(text_start, text);
+  enc->one_pass = 0;
+  for (curr = prog->lines; curr < prog->lines + prog->nlines; curr++) {
+    assemble_line(enc, curr, 0);
+  }
+}
+
+void encode_insns(struct encoder *enc, struct program *prog)
+{
+  struct line *curr;
+
+  enc->text_addr = 0;
+  enc->segment = TEXT;
+  for (curr = prog->lines; curr < prog->lines + prog->nlines; curr++) {
+    if (curr->type == DATA || curr->type == TEXT) {
+      enc->segment = curr->type;
+    } else if (enc->segment == TEXT && curr->type >= NUM_DIRECTIVES) {
+      encode_text(enc, curr);
     }
-    curr = curr->next;
   }
-  symtab_print();
-  encode_text_second_pass(text_start, text);
 }
 
+void encode(struct encoder *enc, struct program *prog)
+{
+  encode_layout(enc, prog);
+  symtab_print(enc->symtab);
+  encode_insns(enc, prog);
+  encoder_finish(enc);
+}
@@ -28,11 +28,109 @@
 #ifndef ENCODE_H_
 #define ENCODE_H_
 
+#include "diag.h"
 #include "parser.h"
+#include "symtab.h"
 
 #include <stdint.h>
 
-void encode(struct line *llh, uint8_t *data, uint8_t *text);
+#define DATA_BEGIN (0x10000000)
+#define TEXT_BEGIN (0x00400000)
+
+/* Default limits on the segment sizes, in bytes */
+#define DATA_SEGMENT_MAX (16*1024*1024)
+#define TEXT_SEGMENT_MAX (16*1024*1024)
+
+struct fixup;
+
+/* State of an assembly run, carried from one line to the next */
+struct encoder {
+  struct symtab *symtab;  /* Labels of the source being assembled */
+  const struct symtab *globals;  /* Labels exported by other sources, or NULL */
+  struct diag *diag;      /* Where errors are reported, NULL for stderr */
+  uint8_t *data;          /* Data segment image */
+  uint8_t *text;          /* Text segment image */
+  uint32_t data_cap;      /* Bytes allocated for data */
+  uint32_t text_cap;      /* Bytes allocated for text */
+  uint32_t data_max;      /* Largest size the data segment may reach */
+  uint32_t text_max;      /* Largest size the text segment may reach */
+  int owns_buffers;       /* The encoder allocates and grows the images */
+  int overrun;            /* Bit DATA or TEXT is set once it was overrun */
+  uint32_t data_base;     /* Address of data[0] */
+  uint32_t text_base;     /* Address of text[0] */
+  uint32_t data_addr;     /* Bytes of data laid out so far */
+  uint32_t text_addr;     /* Bytes of text laid out so far */
+  uint32_t data_align;    /* Largest alignment asked of the data */
+  linetype segment;       /* DATA or TEXT, whichever is being assembled */
+  int one_pass;           /* Leave a fixup for each unresolved label */
+  struct fixup *fixups;   /* Pool of fixups, some of them free */
+  uint32_t nfixups;       /* Used slots of the pool */
+  uint32_t maxfixups;     /* Allocated slots of the pool */
+  uint32_t free_fixup;    /* 1-based index of the first free slot, or 0 */
+};
+
+/**
+ * Assembles @prog with @enc, fresh from encoder_init, in two passes: the
+ * first lays out both segments and defines the labels, the second encodes the
+ * instructions. The sizes of the segments are left in @enc.
+ */
+void encode(struct encoder *enc, struct program *prog);
+
+/**
+ * Starts an assembly run, defining labels in @symtab. The encoder allocates
+ * the segment images and grows them as needed, up to @data_max and @text_max
+ * bytes; they belong to the encoder until encoder_free.
+ *
+ * For a single pass, lines are then fed one at a time to encode_line, and an
+ * instruction that uses a label before its definition is patched once the
+ * label is defined.
+ */
+void encoder_init(struct encoder *enc, struct symtab *symtab,
+                  uint32_t data_max, uint32_t text_max);
+
+/**
+ * Like encoder_init, but assembles into the caller's @data and @text buffers
+ * of @data_size and @text_size bytes, which are the segment size limits.
+ */
+void encoder_init_fixed(struct encoder *enc, struct symtab *symtab,
+                        uint8_t *data, uint32_t data_size, uint8_t *text,
+                        uint32_t text_size);
+
+/**
+ * Makes room in the image of @segment (DATA or TEXT) for the bytes up to
+ * offset @end, reporting an overrun of the segment.
+ *
+ * Returns 0 if the bytes do not fit in the segment.
+ */
+int encoder_reserve(struct encoder *enc, linetype segment, uint32_t end);
+
+/**
+ * Frees the segment images, if the encoder allocated them.
+ */
+void encoder_free(struct encoder *enc);
+
+/**
+ * First of two passes over @prog: emits the data, sizes the text and defines
+ * every label.
+ */
+void encode_layout(struct encoder *enc, struct program *prog);
+
+/**
+ * Second of two passes over @prog: encodes the instructions from the start of
+ * the text segment of @enc, resolving labels through its tables.
+ */
+void encode_insns(struct encoder *enc, struct program *prog);
+
+/**
+ * Assembles the line @l at the current position of its segment.
+ */
+void encode_line(struct encoder *enc, struct line *l);
+
+/**
+ * Ends the run of @enc: reports labels that were never defined, clears the
+ * unused parts of the segments and frees the fixups.
+ */
+void encoder_finish(struct encoder *enc);
 
 #endif /* ENCODE_H_ */
 
@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "image.h"
+#include "elf32.h"
+#include "mxe.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Private Helpers */
+
+/* Checks that [@offset, @offset + @len) lies within the @size bytes */
+static int in_file(size_t size, uint32_t offset, uint32_t len)
+{
+  return offset <= size && len <= size - offset;
+}
+
+static void add_label(struct image *img, uint32_t addr, const char *name)
+{
+  size_t len = strlen(name);
+
+  img->labels[img->nlabels].addr = addr;
+  img->labels[img->nlabels].name = name;
+  img->nlabels++;
+  if (len > img->max_name) img->max_name = len;
+}
+
+static int compare_labels(const void *a, const void *b)
+{
+  const struct image_label *x = a, *y = b;
+
+  if (x->addr != y->addr) return x->addr < y->addr ? -1 : 1;
+  return strcmp(x->name, y->name);
+}
+
+/* Loads a legacy flat image: data words, then as many text words */
+static const char *load_flat(const uint8_t *bytes, size_t size,
+                             struct image *img)
+{
+  if (size % 8 != 0) return "not an .mxe image";
+
+  img->format = "cs4200-riscv32";
+  img->data.bytes = bytes;
+  img->data.addr = IMAGE_DATA_BEGIN;
+  img->data.size = size / 2;
+  img->data_reversed = 1;
+  img->text.bytes = bytes + size / 2;
+  img->text.addr = IMAGE_TEXT_BEGIN;
+  img->text.size = size / 2;
+  return NULL;
+}
+
+/* Loads a sectioned image, see mxe.h */
+static const char *load_mxe(const uint8_t *bytes, size_t size,
+                            struct image *img)
+{
+  const struct mxe_header *hdr = (const struct mxe_header *)bytes;
+  const struct mxe_section *sh, *symsh = NULL, *strsh = NULL;
+  const struct mxe_symbol *sym;
+  const char *names;
+  size_t i;
+
+  if (size < sizeof(*hdr)) return "truncated header";
+  if (hdr->version != MXE_VERSION) return "unsupported version";
+  if (hdr->shoff > size ||
+      hdr->nsections > (size - hdr->shoff) / sizeof(struct mxe_section)) {
+    return "section table past the end of the file";
+  }
+
+  img->format = "cs4200-riscv32";
+  img->has_entry = 1;
+  img->entry = hdr->entry;
+  img->data_reversed = 1;
+
+  sh = (const struct mxe_section *)(bytes + hdr->shoff);
+  for (i = 0; i < hdr->nsections; i++) {
+    struct image_view *v = NULL;
+    switch (sh[i].type) {
+      case MXE_DATA: v = &img->data; break;
+      case MXE_TEXT: v = &img->text; break;
+      case MXE_SYMTAB: symsh = &sh[i]; break;
+      case MXE_STRTAB: strsh = &sh[i]; break;
+    }
+    if (!in_file(size, sh[i].offset, sh[i].size)) {
+      return "section past the end of the file";
+    }
+    if (v) {
+      v->bytes = bytes + sh[i].offset;
+      v->addr = sh[i].addr;
+      v->size = sh[i].size;
+    }
+  }
+
+  if (!symsh || !strsh) return NULL;
+  if (strsh->size && bytes[strsh->offset + strsh->size - 1] != 0) {
+    return "bad symbol section";
+  }
+  sym = (const struct mxe_symbol *)(bytes + symsh->offset);
+  names = (const char *)(bytes + strsh->offset);
+  img->labels = malloc(symsh->size / sizeof(*sym) * sizeof(*img->labels) + 1);
+  if (img->labels == NULL) return "out of memory";
+  for (i = 0; i < symsh->size / sizeof(*sym); i++) {
+    if (sym[i].name >= strsh->size) return "bad symbol name";
+    add_label(img, sym[i].addr, names + sym[i].name);
+  }
+  return NULL;
+}
+
+/* Loads an ELF32 RISC-V executable, such as mas -e writes, see elf32.h */
+static const char *load_elf(const uint8_t *bytes, size_t size,
+                            struct image *img)
+{
+  const struct elf32_ehdr *eh = (const struct elf32_ehdr *)bytes;
+  const struct elf32_shdr *sh, *strsh;
+  const struct elf32_sym *sym;
+  const char *names;
+  size_t i, j, nsyms;
+
+  if (size < sizeof(*eh)) return "truncated header";
+  if (eh->ident[4] != ELF_CLASS32 || eh->ident[5] != ELF_DATA2LSB ||
+      eh->machine != ELF_EM_RISCV) {
+    return "not a 32-bit little-endian RISC-V ELF file";
+  }
+  if (eh->shentsize != sizeof(struct elf32_shdr) ||
+      eh->shoff > size ||
+      eh->shnum > (size - eh->shoff) / sizeof(struct elf32_shdr) ||
+      eh->shoff % 4 != 0) {
+    return "section table past the end of the file";
+  }
+
+  img->format = "elf32-littleriscv";
+  img->has_entry = 1;
+  img->entry = eh->entry;
+
+  /* The first allocated sections that are code and writable are the
+   * segments; anything else loadable is not something mas writes */
+  sh = (const struct elf32_shdr *)(bytes + eh->shoff);
+  for (i = 0; i < eh->shnum; i++) {
+    struct image_view *v = NULL;
+    if (sh[i].type == ELF_SHT_PROGBITS && (sh[i].flags & ELF_SHF_ALLOC)) {
+      if (sh[i].flags & ELF_SHF_EXECINSTR) v = &img->text;
+      else if (sh[i].flags & ELF_SHF_WRITE) v = &img->data;
+    }
+    if (v && !v->bytes) {
+      if (!in_file(size, sh[i].offset, sh[i].size)) {
+        return "section past the end of the file";
+      }
+      v->bytes = bytes + sh[i].offset;
+      v->addr = sh[i].addr;
+      v->size = sh[i].size;
+    }
+  }
+
+  for (i = 0; i < eh->shnum; i++) {
+    if (sh[i].type != ELF_SHT_SYMTAB) continue;
+    if (sh[i].link >= eh->shnum || sh[i].offset % 4 != 0 ||
+        !in_file(size, sh[i].offset, sh[i].size)) {
+      return "bad symbol section";
+    }
+    strsh = &sh[sh[i].link];
+    if (!in_file(size, strsh->offset, strsh->size) ||
+        (strsh->size && bytes[strsh->offset + strsh->size - 1] != 0)) {
+      return "bad symbol section";
+    }
+    sym = (const struct elf32_sym *)(bytes + sh[i].offset);
+    names = (const char *)(bytes + strsh->offset);
+    nsyms = sh[i].size / sizeof(*sym);
+    img->labels = malloc(nsyms * sizeof(*img->labels) + 1);
+    if (img->labels == NULL) return "out of memory";
+    /* Only labels: skip the null symbol, sections and files */
+    for (j = 1; j < nsyms; j++) {
+      if ((sym[j].info & 0xf) > ELF_STT_FUNC || sym[j].shndx == 0) continue;
+      if (sym[j].name >= strsh->size) return "bad symbol name";
+      add_label(img, sym[j].value, names + sym[j].name);
+    }
+    break;
+  }
+  return NULL;
+}
+
+/* Public Interface */
+
+int image_open(struct image *img, const char *infile, const char **why)
+{
+  struct stat st;
+  void *map;
+  int fd;
+
+  memset(img, 0, sizeof(struct image));
+
+  fd = open(infile, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    if (fd >= 0) close(fd);
+    *why = "cannot open";
+    return -1;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    *why = "empty file";
+    return -1;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    *why = "cannot map";
+    return -1;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+  img->map = map;
+  img->map_size = st.st_size;
+
+  if (st.st_size >= 4 && memcmp(map, ELF_MAGIC, 4) == 0) {
+    *why = load_elf(map, st.st_size, img);
+  } else if (st.st_size >= 4 && memcmp(map, MXE_MAGIC, 4) == 0) {
+    *why = load_mxe(map, st.st_size, img);
+  } else {
+    *why = load_flat(map, st.st_size, img);
+  }
+  if (*why) {
+    image_close(img);
+    return -1;
+  }
+
+  /* Labels are looked up by address */
+  if (img->labels) {
+    qsort(img->labels, img->nlabels, sizeof(struct image_label),
+          compare_labels);
+  }
+  return 0;
+}
+
+void image_close(struct image *img)
+{
+  free(img->labels);
+  if (img->map) munmap((void *)img->map, img->map_size);
+  memset(img, 0, sizeof(struct image));
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMAGE_H_
+#define IMAGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Load addresses of the legacy flat image, the same as the assembler's */
+#define IMAGE_DATA_BEGIN (0x10000000)
+#define IMAGE_TEXT_BEGIN (0x00400000)
+
+/* Bytes of a segment, in place in the mapped file */
+struct image_view {
+  const uint8_t *bytes;     /* NULL if the image has no such segment */
+  uint32_t addr;            /* Load address */
+  uint32_t size;
+};
+
+/* A label of the image */
+struct image_label {
+  uint32_t addr;
+  const char *name;
+};
+
+/* An assembled program, as read from the file */
+struct image {
+  const char *format;       /* Name of the file format */
+  int has_entry;
+  uint32_t entry;
+  struct image_view data;
+  struct image_view text;
+  int data_reversed;        /* 1 if each data word is stored byte-reversed */
+  struct image_label *labels;   /* Sorted by address, then name */
+  size_t nlabels;
+  size_t max_name;          /* Length of the longest label */
+  const uint8_t *map;       /* The mapped file */
+  size_t map_size;
+};
+
+/**
+ * Maps the file @infile and finds the segments and labels of the program in
+ * it. The format is told apart by the magic number: ELF (see elf32.h), a
+ * sectioned .mxe image (see mxe.h), or else a legacy flat image, half data
+ * and half text.
+ *
+ * Returns 0 on success. Otherwise returns -1 and stores in @why what is wrong
+ * with the file.
+ */
+int image_open(struct image *img, const char *infile, const char **why);
+
+/**
+ * Unmaps the file of @img and frees its labels.
+ */
+void image_close(struct image *img);
+
+#endif /* IMAGE_H_ */
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "lexer.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Consumed source is handed back in steps of this many bytes */
+#define RELEASE_STEP (256*1024)
+
+/* Private Helpers */
+
+static int is_delimiter(char c)
+{
+  return c == ' ' || c == ',' || c == '\t' || c == '\r';
+}
+
+/* Reads @size bytes of @fd into a malloc'd buffer with a trailing 0. */
+static char *read_source(int fd, size_t size)
+{
+  char *buf = malloc(size + 1);
+  size_t done = 0;
+  ssize_t n;
+
+  if (!buf) return NULL;
+
+  while (done < size) {
+    n = read(fd, buf + done, size - done);
+    if (n <= 0) {
+      free(buf);
+      return NULL;
+    }
+    done += n;
+  }
+  buf[size] = 0;
+  return buf;
+}
+
+/* Public Interface */
+
+int lexer_open(struct lexer *lx, const char *path)
+{
+  struct stat st;
+  long pagesz = sysconf(_SC_PAGESIZE);
+  int fd;
+
+  lx->base = NULL;
+  lx->size = 0;
+  lx->pos = 0;
+  lx->lineno = 0;
+  lx->eol = 1;
+  lx->mapped = 0;
+  lx->released = 0;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) return -1;
+
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return -1;
+  }
+  lx->size = st.st_size;
+
+  /* The zero fill of the last page provides the terminating 0 for free, as
+   * long as the source does not end exactly on a page boundary. */
+  if (lx->size % pagesz != 0) {
+    lx->base = mmap(NULL, lx->size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (lx->base == MAP_FAILED) {
+      lx->base = NULL;
+    } else {
+      lx->mapped = 1;
+      madvise(lx->base, lx->size, MADV_SEQUENTIAL);
+    }
+  }
+
+  if (!lx->base) {
+    lx->base = read_source(fd, lx->size);
+  }
+
+  close(fd);
+  return lx->base ? 0 : -1;
+}
+
+int lexer_open_buffer(struct lexer *lx, const char *src, size_t size)
+{
+  lx->size = size;
+  lx->pos = 0;
+  lx->lineno = 0;
+  lx->eol = 1;
+  lx->mapped = 0;
+  lx->released = 0;
+
+  /* Tokens are terminated in place, so the lexer needs its own copy */
+  lx->base = malloc(size + 1);
+  if (!lx->base) return -1;
+  memcpy(lx->base, src, size);
+  lx->base[size] = 0;
+  return 0;
+}
+
+void lexer_close(struct lexer *lx)
+{
+  if (lx->mapped) {
+    munmap(lx->base, lx->size);
+  } else {
+    free(lx->base);
+  }
+  lx->base = NULL;
+  lx->size = 0;
+}
+
+void lexer_release(struct lexer *lx)
+{
+  size_t end = lx->pos - lx->pos % RELEASE_STEP;
+
+  if (!lx->mapped || end <= lx->released) return;
+
+  /* Dropping private pages of a file mapping reverts them to the file, so
+   * the memory of the copies written by the scanner is given back. */
+  madvise(lx->base + lx->released, end - lx->released, MADV_DONTNEED);
+  lx->released = end;
+}
+
+size_t lexer_count_lines(struct lexer *lx)
+{
+  const char *p = lx->base + lx->pos;
+  const char *end = lx->base + lx->size;
+  size_t n = 1;
+
+  while ((p = memchr(p, '\n', end - p)) != NULL) {
+    n++;
+    p++;
+  }
+  return n;
+}
+
+int lexer_next_line(struct lexer *lx)
+{
+  if (!lx->eol) {
+    while (lx->pos < lx->size && lx->base[lx->pos] != '\n') lx->pos++;
+    lx->pos++;
+  }
+  if (lx->pos >= lx->size) {
+    lx->eol = 1;
+    return 0;
+  }
+  lx->lineno++;
+  lx->eol = 0;
+  return 1;
+}
+
+int lexer_next_token(struct lexer *lx, struct lex_token *tok)
+{
+  char *s = lx->base;
+  size_t end;
+
+  /* Skip delimiters and stop at the end of the line */
+  while (!lx->eol) {
+    if (lx->pos >= lx->size) {
+      lx->eol = 1;
+    } else if (s[lx->pos] == '\n') {
+      lx->pos++;
+      lx->eol = 1;
+    } else if (s[lx->pos] == '#') {
+      while (lx->pos < lx->size && s[lx->pos] != '\n') lx->pos++;
+    } else if (is_delimiter(s[lx->pos])) {
+      lx->pos++;
+    } else {
+      break;
+    }
+  }
+  if (lx->eol) return 0;
+
+  end = lx->pos;
+  if (s[end] == '"') {
+    /* Strings run to the closing quote, delimiters included */
+    end++;
+    while (end < lx->size && s[end] != '"' && s[end] != '\n') end++;
+    if (end < lx->size && s[end] == '"') end++;
+  } else {
+    while (end < lx->size && !is_delimiter(s[end]) &&
+           s[end] != '\n' && s[end] != '#') {
+      end++;
+    }
+  }
+
+  tok->off = lx->pos;
+  tok->len = end - lx->pos;
+
+  /* Terminate the token in place, consuming whatever ended it */
+  lx->pos = end;
+  if (end < lx->size) {
+    if (s[end] == '\n') {
+      lx->pos++;
+      lx->eol = 1;
+    } else if (s[end] == '#') {
+      while (lx->pos < lx->size && s[lx->pos] != '\n') lx->pos++;
+    } else {
+      lx->pos++;
+    }
+    s[end] = 0;
+  }
+
+  return 1;
+}
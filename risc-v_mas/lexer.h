@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEXER_H_
+#define LEXER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A token is a slice of the source text, given as an offset from the start
+ * of the source and a length in bytes.
+ */
+struct lex_token {
+  uint32_t off;
+  uint32_t len;
+};
+
+/**
+ * Scanner over a source file that is mapped into memory.
+ *
+ * The mapping is private and writable: every token is NUL-terminated in
+ * place, so a token's text can be used as a C string without copying it.
+ * The byte just past the end of the source is always readable and zero.
+ */
+struct lexer {
+  char *base;       /* start of the source text */
+  size_t size;      /* bytes of source text */
+  size_t pos;       /* next byte to scan */
+  uint32_t lineno;  /* 1-based number of the current line */
+  int eol;          /* set once the current line has no more tokens */
+  int mapped;       /* base came from mmap (else from malloc) */
+  size_t released;  /* bytes at the start handed back by lexer_release */
+};
+
+/**
+ * Maps the file named @path for scanning.
+ *
+ * Returns 0 on success, or -1 if the file could not be opened or read.
+ */
+int lexer_open(struct lexer *lx, const char *path);
+
+/**
+ * Scans a copy of the @size bytes of source text at @src.
+ *
+ * Returns 0 on success, or -1 if out of memory.
+ */
+int lexer_open_buffer(struct lexer *lx, const char *src, size_t size);
+
+/**
+ * Releases the source text. Tokens returned by @lx are invalid afterward.
+ */
+void lexer_close(struct lexer *lx);
+
+/**
+ * Hands back the memory of the source text before the current position, so
+ * that scanning a large file sequentially keeps only a window of it resident.
+ * Tokens that lie before the current position are invalid afterward.
+ */
+void lexer_release(struct lexer *lx);
+
+/**
+ * Returns an upper bound on the number of lines left in the source.
+ */
+size_t lexer_count_lines(struct lexer *lx);
+
+/**
+ * Advances to the next source line, skipping what is left of the current one.
+ *
+ * Returns 0 when there is no more input.
+ */
+int lexer_next_line(struct lexer *lx);
+
+/**
+ * Scans the next token of the current line into @tok.
+ *
+ * Tokens are separated by spaces, tabs and commas, and a '#' starts a comment
+ * that runs to the end of the line. A token starting with '"' extends to the
+ * closing '"' and keeps any delimiters inside it.
+ *
+ * Returns 0 when the current line has no more tokens.
+ */
+int lexer_next_token(struct lexer *lx, struct lex_token *tok);
+
+/**
+ * Returns the NUL-terminated text of @tok.
+ */
+static inline char *lexer_text(struct lexer *lx, struct lex_token *tok)
+{
+  return lx->base + tok->off;
+}
+
+#endif /* LEXER_H_ */
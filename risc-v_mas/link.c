@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "link.h"
+#include "encode.h"
+#include "parser.h"
+#include "symtab.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Private Helpers */
+
+/* One source file on its way to being linked */
+struct unit {
+  char *file;             /* Name of the source */
+  struct program *prog;   /* Its parsed lines, NULL if it could not be read */
+  struct symtab symtab;   /* Its labels */
+  struct encoder enc;     /* Its assembly state and segment images */
+  struct diag diag;       /* Its errors, printed to stderr and counted */
+  uint32_t data_off;      /* Where its data goes in the linked segment */
+  uint32_t text_off;      /* Where its text goes in the linked segment */
+};
+
+/* Work shared by the threads of the pool: one call of work per unit */
+struct pool {
+  struct unit *units;
+  int nunits;
+  int next;               /* Index of the next unit to hand out */
+  void (*work)(struct unit *u);
+};
+
+/* Parses @u and lays out its segments, defining its labels */
+static void layout_unit(struct unit *u)
+{
+  u->prog = get_lines(u->file, &u->diag);
+  if (!u->prog) return;
+
+  encode_layout(&u->enc, u->prog);
+}
+
+/* Encodes the instructions of @u, now placed at its link offsets */
+static void encode_unit(struct unit *u)
+{
+  if (!u->prog) return;
+
+  encode_insns(&u->enc, u->prog);
+  encoder_finish(&u->enc);
+}
+
+static void *pool_worker(void *arg)
+{
+  struct pool *p = arg;
+  int i;
+
+  while ((i = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED)) < p->nunits) {
+    p->work(&p->units[i]);
+  }
+  return NULL;
+}
+
+/* Calls @work on each of the @nunits @units, using up to @nthreads threads */
+static void run_pool(struct unit *units, int nunits, int nthreads,
+                     void (*work)(struct unit *u))
+{
+  struct pool p = { units, nunits, 0, work };
+  pthread_t *threads;
+  int i, started = 0;
+
+  if (nthreads > nunits) nthreads = nunits;
+  threads = malloc(nthreads * sizeof(pthread_t));
+
+  /* The calling thread is part of the pool, so none have to start at all */
+  for (i = 1; threads && i < nthreads; i++) {
+    if (pthread_create(&threads[started], NULL, pool_worker, &p) != 0) break;
+    started++;
+  }
+  pool_worker(&p);
+  for (i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+
+/* Lists the label @lbl of a unit in the linked table @arg, if it is not yet */
+static void add_label(void *arg, const char *lbl, uint32_t addr)
+{
+  uint32_t pending;
+
+  symtab_add(arg, lbl, addr, &pending);
+}
+
+/**
+ * Places the segments of each unit after those of the previous one, moves
+ * its labels along and collects the exported labels in @globals.
+ *
+ * Returns the number of units that failed.
+ */
+static int place_units(struct unit *units, int nunits, struct encoder *out)
+{
+  struct symtab *globals = out->symtab;
+  uint32_t *data_end = &out->data_addr, *text_end = &out->text_addr;
+  struct unit *u;
+  int errors = 0;
+
+  for (u = units; u < units + nunits; u++) {
+    if (!u->prog) {
+      fprintf(stderr, "Error getting the lines of file: %s\n", u->file);
+      errors++;
+      continue;
+    }
+    if (u->enc.overrun) errors++;
+
+    /* Keep every .align of the unit valid in the linked segment */
+    u->data_off = (*data_end + u->enc.data_align - 1) &
+                  ~(u->enc.data_align - 1);
+    u->text_off = *text_end;
+    *data_end = u->data_off + u->enc.data_addr;
+    *text_end = u->text_off + u->enc.text_addr;
+
+    symtab_relocate(&u->symtab, u->enc.data_base,
+                    u->enc.data_base + u->enc.data_addr + 1, u->data_off);
+    symtab_relocate(&u->symtab, u->enc.text_base,
+                    u->enc.text_base + u->enc.text_addr + 1, u->text_off);
+    u->enc.data_base += u->data_off;
+    u->enc.text_base += u->text_off;
+    u->enc.globals = globals;
+
+    if (symtab_merge_exports(globals, &u->symtab, &u->diag) != 0) errors++;
+  }
+
+  /* Both images are allocated whole, to be filled from the units in turn.
+   * The .align padding between units is not, so data starts out zeroed. */
+  if (encoder_reserve(out, DATA, *data_end)) {
+    memset(out->data, 0, *data_end);
+  } else {
+    errors++;
+  }
+  if (!encoder_reserve(out, TEXT, *text_end)) errors++;
+  return errors;
+}
+
+/* Public Interface */
+
+int link_files(char **files, int nfiles, int nthreads, struct encoder *out)
+{
+  struct unit *units = calloc(nfiles, sizeof(struct unit));
+  struct unit *u;
+  int errors;
+
+  if (!units) return nfiles;
+
+  for (u = units; u < units + nfiles; u++) {
+    u->file = files[u - units];
+    symtab_init(&u->symtab);
+    encoder_init(&u->enc, &u->symtab, out->data_max, out->text_max);
+    u->enc.diag = &u->diag;
+  }
+
+  /* The units are independent until their labels are placed */
+  run_pool(units, nfiles, nthreads, layout_unit);
+  errors = place_units(units, nfiles, out);
+
+  /* Only the read-only globals are shared while encoding */
+  run_pool(units, nfiles, nthreads, encode_unit);
+
+  for (u = units; u < units + nfiles; u++) {
+    if (u->prog && errors == 0) {
+      memcpy(out->data + u->data_off, u->enc.data, u->enc.data_addr);
+      memcpy(out->text + u->text_off, u->enc.text, u->enc.text_addr);
+
+      /* Encoding is done, so the labels of each unit may be listed now
+       * without becoming visible to the others */
+      symtab_foreach(&u->symtab, add_label, out->symtab);
+    }
+    if (u->prog) free_lines(u->prog);
+    if (out->diag) out->diag->nerrors += u->diag.nerrors;
+    encoder_free(&u->enc);
+    symtab_free(&u->symtab);
+  }
+  if (errors == 0) encoder_finish(out);
+  symtab_print(out->symtab);
+
+  free(units);
+  return errors;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LINK_H_
+#define LINK_H_
+
+#include "encode.h"
+
+/**
+ * Assembles the @nfiles sources named in @files on up to @nthreads threads
+ * and links them into the segments of @out, fresh from encoder_init. Each
+ * source gets its own symbol table; only labels it names in a .globl
+ * directive are visible to the others, and those are defined in the table of
+ * @out. Once the sources are linked, that table also lists their other labels
+ * at the linked addresses; a name that several sources define is listed once,
+ * for the one that exports it or else the first in order. The segments of the
+ * sources are placed in the order given, and each is held to the limits of
+ * @out. Errors in the sources are printed to stderr and counted in out->diag,
+ * if it has one.
+ *
+ * Returns the number of sources that could not be read or linked.
+ */
+int link_files(char **files, int nfiles, int nthreads, struct encoder *out);
+
+#endif /* LINK_H_ */
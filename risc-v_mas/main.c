@@ -1,55 +1,213 @@
-
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "encode.h"
+#include "link.h"
 #include "parser.h"
+#include "symtab.h"
 #include "writer.h"
 
 static void usage(char *name)
 {
-  printf("Usage: %s [input source]\n\
+  printf("Usage: %s [-s] [-l | -e] [-g] [-j threads] [-d size] [-t size]\n\
+\t[input source]...\n\
 where:\n\
-\t[input source] is a file containing assembly source code.\n\
-", name);
+\t-s assembles each line as it is read, patching forward references.\n\
+\t-l writes the legacy flat image of %d data and %d text words.\n\
+\t-e writes an ELF32 RISC-V executable with a symbol table to a.out.\n\
+\t-g adds the labels to the image, in a symbol section.\n\
+\t-j sets how many sources are assembled at once (default: one per CPU).\n\
+\t-d, -t limit the size of the data and text segments, in bytes or with a\n\
+\t\tk or M suffix (default: %dM each).\n\
+\t[input source] is a file containing assembly source code. Several\n\
+\t\tsources are linked in the order given; each one only sees the\n\
+\t\tlabels of the others that are named in a .globl directive.\n\
+", name, DATA_SEGMENT_WORDS, TEXT_SEGMENT_WORDS,
+  DATA_SEGMENT_MAX / (1024*1024));
   exit(1);
 }
 
 
-int main( int argc, char *argv[] )
+/* Parses all of @infile, then encodes it in two passes */
+static int assemble(char *infile, struct encoder *enc)
 {
-  struct line* llh;
-  uint32_t *text_segment, *data_segment;
-  size_t prog_sz;
+  struct program* prog;
 
-  if ( argc < 2 ) usage(argv[0]);
+  prog = get_lines(infile, enc->diag);
+  if (!prog) return -1;
+
+  print_lines(prog);
+  encode(enc, prog);
+  free_lines(prog);
+  return 0;
+}
+
+/* Encodes each line of @infile as soon as it is parsed */
+static int assemble_streaming(char *infile, struct encoder *enc)
+{
+  struct line_reader reader;
+  struct line *l;
+  size_t nlines = 0;
 
-  llh = get_lines(argv[1]);
-  if (!llh) {
-    fprintf(stderr, "Error getting the lines of file: %s\n", argv[1]);
-    exit(1);
+  if (line_reader_open(&reader, infile, enc->diag) != 0) return -1;
+
+  while ((l = line_reader_next(&reader)) != NULL) {
+    print_line(l);
+    encode_line(enc, l);
+    nlines++;
   }
+  line_reader_close(&reader);
 
-  print_lines(llh);
+  symtab_print(enc->symtab);
+  encoder_finish(enc);
+  return nlines ? 0 : -1;
+}
 
-  data_segment = malloc(sizeof(uint32_t)*DATA_SEGMENT_WORDS);
-  text_segment = malloc(sizeof(uint32_t)*TEXT_SEGMENT_WORDS);
+/* Parses a segment size such as 4096, 64k or 2M. Returns 0 if invalid. */
+static uint32_t parse_size(char *s, uint32_t max)
+{
+  char *end;
+  unsigned long n = strtoul(s, &end, 0);
 
-  if (data_segment == NULL || text_segment == NULL) {
-    fprintf(stderr, "Uh oh, looks like we ran out of memory!\n");
-    exit(1);
+  if (*end == 'k' || *end == 'K') {
+    n *= 1024;
+    end++;
+  } else if (*end == 'm' || *end == 'M') {
+    n *= 1024*1024;
+    end++;
   }
+  if (*end != '\0' || n > max) return 0;
+  return n;
+}
 
-  /* TODO: convert the lines in llh into data and text segment binary
-   * representations */
-  encode(llh, (uint8_t*)data_segment, (uint8_t*)text_segment);
+int main( int argc, char *argv[] )
+{
+  struct segment data, text;
+  struct symtab symtab;
+  struct encoder enc;
+  struct diag diag = { NULL, NULL, 0 };
+  uint32_t data_max = DATA_SEGMENT_MAX;
+  uint32_t text_max = TEXT_SEGMENT_MAX;
+  uint8_t *flat_data, *flat_text;
+  uint32_t entry;
+  ssize_t prog_sz;
+  int one_pass = 0;
+  int flat = 0;
+  int elf = 0;
+  int symbols = 0;
+  int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  int opt;
+  int rc;
 
-  prog_sz = write_program("a.mxe", text_segment, data_segment);
-  assert(prog_sz == DATA_SEGMENT_WORDS+TEXT_SEGMENT_WORDS);
+  while ((opt = getopt(argc, argv, "slegj:d:t:")) != -1) {
+    switch (opt) {
+      case 's':
+        one_pass = 1;
+        break;
+      case 'l':
+        flat = 1;
+        break;
+      case 'e':
+        elf = 1;
+        break;
+      case 'g':
+        symbols = 1;
+        break;
+      case 'j':
+        nthreads = atoi(optarg);
+        if (nthreads < 1) usage(argv[0]);
+        break;
+      case 'd':
+        /* The data segment may run up to the top of the address space */
+        data_max = parse_size(optarg, 0 - DATA_BEGIN);
+        if (!data_max) usage(argv[0]);
+        break;
+      case 't':
+        /* The text segment must stay below the data segment */
+        text_max = parse_size(optarg, DATA_BEGIN - TEXT_BEGIN);
+        if (!text_max) usage(argv[0]);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if ( optind >= argc ) usage(argv[0]);
+  if ( one_pass && argc - optind > 1 ) usage(argv[0]);
+  if ( flat && elf ) usage(argv[0]);
+
+  if (flat) {
+    data_max = sizeof(uint32_t)*DATA_SEGMENT_WORDS;
+    text_max = sizeof(uint32_t)*TEXT_SEGMENT_WORDS;
+  }
+
+  symtab_init(&symtab);
+  encoder_init(&enc, &symtab, data_max, text_max);
+  enc.diag = &diag;
+
+  if (argc - optind > 1) {
+    if (link_files(&argv[optind], argc - optind, nthreads > 0 ? nthreads : 1,
+                   &enc) != 0) {
+      exit(1);
+    }
+  } else {
+    if (one_pass) {
+      rc = assemble_streaming(argv[optind], &enc);
+    } else {
+      rc = assemble(argv[optind], &enc);
+    }
+    if (rc != 0) {
+      fprintf(stderr, "Error getting the lines of file: %s\n", argv[optind]);
+      exit(1);
+    }
+  }
+
+  /* Errors were reported as found; an image with them would be wrong */
+  if (enc.overrun || diag.nerrors > 0) exit(1);
+
+  data.bytes = enc.data;
+  data.addr = DATA_BEGIN;
+  data.size = enc.data_addr;
+  text.bytes = enc.text;
+  text.addr = TEXT_BEGIN;
+  text.size = enc.text_addr;
 
-  free_lines(llh);
+  if (flat) {
+    flat_data = calloc(DATA_SEGMENT_WORDS, sizeof(uint32_t));
+    flat_text = calloc(TEXT_SEGMENT_WORDS, sizeof(uint32_t));
+    if (flat_data == NULL || flat_text == NULL) {
+      fprintf(stderr, "Uh oh, looks like we ran out of memory!\n");
+      exit(1);
+    }
+    if (data.size) memcpy(flat_data, data.bytes, data.size);
+    if (text.size) memcpy(flat_text, text.bytes, text.size);
+    prog_sz = write_program("a.mxe", (uint32_t*)flat_text,
+                            (uint32_t*)flat_data);
+    assert(prog_sz == DATA_SEGMENT_WORDS+TEXT_SEGMENT_WORDS);
+    free(flat_data);
+    free(flat_text);
+  } else if (elf) {
+    if (!symtab_find(&symtab, "main", &entry)) entry = TEXT_BEGIN;
+    prog_sz = write_elf("a.out", entry, &data, &text, &symtab);
+    if (prog_sz < 0) {
+      fprintf(stderr, "Error writing the program to a.out\n");
+      exit(1);
+    }
+  } else {
+    if (!symtab_find(&symtab, "main", &entry)) entry = TEXT_BEGIN;
+    prog_sz = write_mxe("a.mxe", entry, &data, &text,
+                        symbols ? &symtab : NULL);
+    if (prog_sz < 0) {
+      fprintf(stderr, "Error writing the program to a.mxe\n");
+      exit(1);
+    }
+  }
+
+  encoder_free(&enc);
+  symtab_free(&symtab);
 
   return 0;
 }
-
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mas.h"
+#include "encode.h"
+#include "parser.h"
+
+#include <string.h>
+
+/* Public Interface */
+
+void mas_init(struct mas_context *ctx, uint8_t *data, uint32_t data_cap,
+              uint8_t *text, uint32_t text_cap)
+{
+  memset(ctx, 0, sizeof(struct mas_context));
+  symtab_init(&ctx->symtab);
+  ctx->data = data;
+  ctx->data_cap = data_cap;
+  ctx->text = text;
+  ctx->text_cap = text_cap;
+}
+
+unsigned int mas_assemble(struct mas_context *ctx, const char *src,
+                          size_t size)
+{
+  struct program *prog;
+  struct encoder enc;
+  struct line *l;
+
+  symtab_clear(&ctx->symtab);
+  ctx->diag.nerrors = 0;
+  ctx->data_size = ctx->text_size = 0;
+
+  prog = get_lines_buffer(src, size, &ctx->diag);
+  if (!prog) {
+    if (ctx->diag.nerrors == 0) {
+      diag_error(&ctx->diag, "No lines in the source");
+    }
+    memset(ctx->data, 0, ctx->data_cap);
+    memset(ctx->text, 0, ctx->text_cap);
+    return ctx->diag.nerrors;
+  }
+
+  encoder_init_fixed(&enc, &ctx->symtab, ctx->data, ctx->data_cap,
+                     ctx->text, ctx->text_cap);
+  enc.diag = &ctx->diag;
+  if (ctx->opts.one_pass) {
+    for (l = prog->lines; l < prog->lines + prog->nlines; l++) {
+      encode_line(&enc, l);
+    }
+  } else {
+    encode_layout(&enc, prog);
+    encode_insns(&enc, prog);
+  }
+  encoder_finish(&enc);
+
+  ctx->data_size = enc.data_addr;
+  ctx->text_size = enc.text_addr;
+  free_lines(prog);
+  return ctx->diag.nerrors;
+}
+
+int mas_symbol(const struct mas_context *ctx, const char *lbl, uint32_t *addr)
+{
+  return symtab_find(&ctx->symtab, lbl, addr);
+}
+
+void mas_free(struct mas_context *ctx)
+{
+  symtab_free(&ctx->symtab);
+}
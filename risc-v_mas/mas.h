@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MAS_H_
+#define MAS_H_
+
+/*
+ * libmas: the assembler as a library. Each context carries all the state of
+ * an assembly, so contexts can be used from several threads at once, and one
+ * context can assemble any number of sources in turn.
+ */
+
+#include "diag.h"
+#include "symtab.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct mas_options {
+  int one_pass;           /* Assemble each line as it is read */
+};
+
+struct mas_context {
+  struct mas_options opts;  /* How to assemble, zero for the defaults */
+  struct diag diag;       /* Errors of the last source, see diag.h */
+  struct symtab symtab;   /* Labels of the last source */
+  uint8_t *data;          /* Data segment */
+  uint8_t *text;          /* Text segment */
+  uint32_t data_cap;      /* Bytes in the data segment buffer */
+  uint32_t text_cap;      /* Bytes in the text segment buffer */
+  uint32_t data_size;     /* Bytes of data in the last source */
+  uint32_t text_size;     /* Bytes of text in the last source */
+};
+
+/**
+ * Initializes @ctx to assemble into the caller's @data and @text buffers of
+ * @data_cap and @text_cap bytes, reporting errors to stderr. The caller may
+ * then set the options and ctx->diag.report.
+ */
+void mas_init(struct mas_context *ctx, uint8_t *data, uint32_t data_cap,
+              uint8_t *text, uint32_t text_cap);
+
+/**
+ * Assembles the @size bytes of source text at @src into the segments of
+ * @ctx, replacing whatever the previous call assembled. The segments are laid
+ * out as in an .mxe image: text words in host order, data words big-endian,
+ * and zero past the assembled bytes. A source that does not fit is an error.
+ *
+ * Returns the number of errors reported, 0 on success.
+ */
+unsigned int mas_assemble(struct mas_context *ctx, const char *src,
+                          size_t size);
+
+/**
+ * Looks up the label @lbl of the last source and stores its address in
+ * @addr.
+ *
+ * Returns 1 if @lbl is defined, 0 if it is not.
+ */
+int mas_symbol(const struct mas_context *ctx, const char *lbl, uint32_t *addr);
+
+/**
+ * Frees the memory owned by @ctx. The segments belong to the caller.
+ */
+void mas_free(struct mas_context *ctx);
+
+#endif /* MAS_H_ */
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Build-time generator of the perfect hash table for the mnemonics listed in
+ * mnemonics.def. Writes the table to stdout as a C header.
+ */
+
+#include "mnemonic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SEEDS (1U<<20)
+
+static const char *names[] = {
+#define DIRECTIVE(t, name) name,
+#define INSTRUCTION(t, name, ...) name,
+#define PSEUDO(t, name, ...) name,
+#include "mnemonics.def"
+};
+
+#define NUM_NAMES (sizeof(names)/sizeof(names[0]))
+
+/* Returns 1 if @seed sends every name to its own slot of @slots. */
+static int try_seed(uint32_t seed, struct mnemonic_slot *slots, uint32_t size)
+{
+  uint32_t i, h;
+
+  memset(slots, 0, size*sizeof(struct mnemonic_slot));
+  for (i = 0; i < NUM_NAMES; i++) {
+    h = mnemonic_hash(names[i], strlen(names[i]), seed) & (size-1);
+    if (slots[h].len) return 0;
+    slots[h].type = i;
+    slots[h].len = strlen(names[i]);
+  }
+  return 1;
+}
+
+int main(void)
+{
+  struct mnemonic_slot *slots;
+  uint32_t size, seed, i;
+
+  if (NUM_NAMES >= 256) {
+    fprintf(stderr, "mkhash: too many mnemonics for 8-bit slots\n");
+    return 1;
+  }
+
+  /* Start at twice the key count and grow until some seed is perfect */
+  for (size = 1; size < 2*NUM_NAMES; size *= 2);
+  for (;; size *= 2) {
+    slots = malloc(size*sizeof(struct mnemonic_slot));
+    if (!slots) return 1;
+    for (seed = 1; seed < MAX_SEEDS; seed++) {
+      if (try_seed(seed, slots, size)) goto found;
+    }
+    free(slots);
+  }
+
+found:
+  printf("/* Generated by mkhash from mnemonics.def. Do not edit. */\n\n");
+  printf("#ifndef MNEMONIC_TABLE_H_\n#define MNEMONIC_TABLE_H_\n\n");
+  printf("#include \"mnemonic.h\"\n\n");
+  printf("#define MNEMONIC_SEED (0x%xU)\n", seed);
+  printf("#define MNEMONIC_SLOTS (%u)\n\n", size);
+  printf("static const struct mnemonic_slot mnemonic_slots[MNEMONIC_SLOTS] = {\n");
+  for (i = 0; i < size; i++) {
+    if (slots[i].len) {
+      printf("  [%u] = { %u, %u }, /* %s */\n",
+          i, slots[i].type, slots[i].len, names[slots[i].type]);
+    }
+  }
+  printf("};\n\n#endif /* MNEMONIC_TABLE_H_ */\n");
+
+  free(slots);
+  return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MNEMONIC_H_
+#define MNEMONIC_H_
+
+#include <stdint.h>
+
+/*
+ * Mnemonics are classified through a perfect hash table that mkhash generates
+ * from mnemonics.def at build time, as mnemonic_table.h. Every mnemonic owns
+ * a distinct slot, so a lookup hashes once and compares once.
+ */
+
+/* Slot of the generated table. Empty slots have a len of 0. */
+struct mnemonic_slot {
+  uint8_t type;   /* linetype of the mnemonic in this slot */
+  uint8_t len;    /* length of its name */
+};
+
+/**
+ * Hashes the @len bytes at @s under @seed. The table size is a power of two and
+ * the slot is the hash masked to the table size.
+ */
+static inline uint32_t mnemonic_hash(const char *s, uint32_t len,
+                                     uint32_t seed)
+{
+  uint32_t h = seed ^ len;
+
+  while (len--) {
+    h = (h ^ (uint8_t)*s++) * 0x01000193; /* FNV-1a step */
+  }
+  return h ^ (h >> 15);
+}
+
+#endif /* MNEMONIC_H_ */
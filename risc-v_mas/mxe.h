@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MXE_H_
+#define MXE_H_
+
+/*
+ * Layout of a sectioned .mxe image:
+ *
+ *   struct mxe_header
+ *   struct mxe_section[nsections]   (at shoff)
+ *   section contents                (each at its offset, 4-byte aligned)
+ *
+ * All fields are little-endian. Section contents are the segment bytes as
+ * the assembler lays them out: text words little-endian, data words
+ * big-endian. A section only holds the bytes that were assembled; memory
+ * past its size up to the next section is zero.
+ *
+ * The legacy flat image has no header: it is DATA_SEGMENT_WORDS data words
+ * followed by TEXT_SEGMENT_WORDS text words, loaded at DATA_BEGIN and
+ * TEXT_BEGIN.
+ */
+
+#include <stdint.h>
+
+#define MXE_MAGIC "\177MXE"
+#define MXE_VERSION (1)
+
+struct mxe_header {
+  char magic[4];          /* MXE_MAGIC */
+  uint16_t version;       /* MXE_VERSION */
+  uint16_t nsections;     /* Entries in the section table */
+  uint32_t entry;         /* Address of the first instruction to run */
+  uint32_t shoff;         /* File offset of the section table */
+};
+
+enum mxe_section_type {
+  MXE_DATA = 1,           /* Data segment */
+  MXE_TEXT = 2,           /* Text segment */
+  MXE_SYMTAB = 3,         /* struct mxe_symbol entries, sorted by address */
+  MXE_STRTAB = 4,         /* NUL-terminated names of the symbols */
+};
+
+struct mxe_section {
+  uint32_t type;          /* enum mxe_section_type */
+  uint32_t addr;          /* Load address, 0 if not loaded */
+  uint32_t offset;        /* File offset of the contents */
+  uint32_t size;          /* Bytes of contents */
+};
+
+struct mxe_symbol {
+  uint32_t addr;          /* Address of the label */
+  uint32_t name;          /* Offset of the name in the MXE_STRTAB section */
+};
+
+#endif /* MXE_H_ */
@@ -26,6 +26,7 @@
  */
 
 #include "parser.h"
+#include "mnemonic_table.h"
 
 #include <assert.h>
 #include <stdint.h>
@@ -39,247 +40,248 @@
 
 /* Private Helpers */
 
-/* delimiters between tokens in the assembly syntax */
-#define DELIMITERS " ,\t"
-
 char *directives[NUM_DIRECTIVES] = {
-  ".align",
-  ".asciiz",
-  ".data",
-  ".space",
-  ".text",
-  ".word"
+#define DIRECTIVE(t, name) name,
+#define INSTRUCTION(t, name, ...)
+#define PSEUDO(t, name, ...)
+#include "mnemonics.def"
+#undef DIRECTIVE
+#undef INSTRUCTION
+#undef PSEUDO
 };
 
 char *instructions[NUM_INSTS] = {
-  "add",
-  "addi",
-  "and",
-  "andi",
-  "auipc",
-  "beq",
-  "bne",
-  "jal",
-  "jalr",
-  "lui",
-  "lw",
-  "or",
-  "ori",
-  "slt",
-  "slti",
-  "sll",
-  "slli",
-  "sra",
-  "srai",
-  "srl",
-  "srli",
-  "sub",
-  "sw",
-  "xor",
-  "xori",
-  "ecall",
-  /* Psuedoinstructions */
-  "j",
-  "la",
-  "li",
-  "mv",
-  "neg",
-  "nop",
-  "not",
-  "ret"
+#define DIRECTIVE(t, name)
+#define INSTRUCTION(t, name, ...) name,
+#define PSEUDO(t, name, ...) name,
+#include "mnemonics.def"
+#undef DIRECTIVE
+#undef INSTRUCTION
+#undef PSEUDO
 };
 
+static char *mnemonic_name(linetype t)
+{
+  return t < NUM_DIRECTIVES ? directives[t] : instructions[t - NUM_DIRECTIVES];
+}
 
-void free_token_list(struct token_node *token_listhead)
+/**
+ * Looks up the linetype of the mnemonic @s of length @len.
+ *
+ * Returns -1 if @s is not exactly a known directive or instruction.
+ */
+static int classify(const char *s, uint32_t len)
 {
-  struct token_node *curr = token_listhead, *next;
+  const struct mnemonic_slot *slot;
 
-  while (curr != NULL) {
-    next = curr->next;
-    free(curr);
-    curr = next;
+  slot = &mnemonic_slots[mnemonic_hash(s, len, MNEMONIC_SEED) &
+                         (MNEMONIC_SLOTS-1)];
+  if (slot->len != len || memcmp(s, mnemonic_name(slot->type), len) != 0) {
+    return -1;
   }
+  return slot->type;
 }
 
-static void strip_comments(char *s, size_t len)
+/* Scans the tokens of the current line into @tb. Returns the token count. */
+static size_t scan_tokens(struct lexer *lx, struct token_buf *tb)
 {
-  int i;
-  for (i = 0; i < len; i++) {
-    if (s[i] == '#') s[i] = 0;
-    if (s[i] == 0) break;
+  size_t n = 0;
+  struct lex_token tok;
+
+  while (lexer_next_token(lx, &tok)) {
+    if (n == tb->cap) {
+      tb->cap = tb->cap ? 2*tb->cap : 16;
+      tb->v = realloc(tb->v, tb->cap * sizeof(struct lex_token));
+      assert(tb->v);
+    }
+    tb->v[n++] = tok;
   }
+  return n;
 }
 
 /**
- * Reads the next line from the file stream @in.
+ * Reads the next line from the source scanned by @lx into @next, allocating
+ * its tokens from @arena.
  *
- * Returns an allocated line or NULL if no more lines or error occured.
+ * Returns 0 if no more lines or error occured.
  */
-static struct line* get_next_line(FILE *in)
+static int get_next_line(struct lexer *lx, struct arena *arena,
+                         struct token_buf *tb, struct diag *diag,
+                         struct line *next)
 {
-  int i, sh;
-  unsigned int end;
-  struct line* next = calloc(1, sizeof(struct line));
-  struct token_node *tn, *curr;
-  char *linebuf = NULL;
-  size_t linesz = 0;
-  char *token = NULL;
-
-#ifdef DEBUG
-  assert(next);
-#endif
-  if (!next) return NULL;
+  int i, type;
+  size_t n, first;
+  char *label = NULL;
+  char *token;
 
   /* Find start of the next line. Eat whitespace and pick up label if any */
-  while (token == NULL) {
-    if (linebuf) {
-      free(linebuf);
-      linebuf = NULL;
-      linesz = 0;
-    }
-    if (getline(&linebuf, &linesz, in) <= 0) {
-      free(next);
-      return NULL;
-    }
-    end = strnlen(linebuf, linesz);
-    while (end > 0 && (linebuf[end-1] == '\n' || linebuf[end-1] == '\r')) {
-      linebuf[--end] = 0; // eat newline
-    }
-    strip_comments(linebuf, linesz);
-    token = strtok(linebuf, DELIMITERS);
+  do {
+    if (!lexer_next_line(lx)) return 0;
+    n = scan_tokens(lx, tb);
+    first = 0;
 
     /* Check for a label. Only keep one label. */
-    if (token && token[strlen(token)-1] == ':') {
-      if (next->label) free(next->label);
-      next->label = strdup(token);
-      token = strtok(NULL, DELIMITERS);
+    if (n > 0) {
+      token = lexer_text(lx, &tb->v[0]);
+      if (token[tb->v[0].len-1] == ':') {
+        token[tb->v[0].len-1] = 0;
+        label = token;
+        first = 1;
+      }
     }
-  }
+  } while (first == n);
 
-  /* Check for assembler directives */
-  for (i = 0; i < NUM_DIRECTIVES; i++) {
-    if (strncmp(token, directives[i], sizeof(directives[i])) == 0) {
-      next->type = (linetype)i;
-      break;
-    }
+  token = lexer_text(lx, &tb->v[first]);
+  type = classify(token, tb->v[first].len);
+
+  /* Error if token is not a directive or instruction. */
+  if (type < 0) {
+    diag_error(diag, "Parser error, unrecognized symbol: %s", token);
+    return 0;
   }
 
-  if (i == NUM_DIRECTIVES) {
-    /* Check for instructions */
-    for (i = 0; i < NUM_INSTS; i++) {
-      if (strncmp(token, instructions[i], sizeof(instructions[i])) == 0) {
-        next->type = NUM_DIRECTIVES + i;
-        break;
-      }
-    }
+  next->type = type;
+  next->label = label;
+  next->ntokens = n - first;
+  next->tokens = arena_alloc(arena, next->ntokens * sizeof(struct token));
+#ifdef DEBUG
+  assert(next->tokens);
+#endif
+  if (!next->tokens) return 0;
+
+  for (i = 0; i < next->ntokens; i++) {
+    next->tokens[i].token = lexer_text(lx, &tb->v[first+i]);
+    next->tokens[i].len = tb->v[first+i].len;
   }
 
-  /* Error if token is not a directive or instruction. */
-  if (i == NUM_INSTS) {
-    fprintf(stderr, "Parser error, unrecognized symbol: %s\n", token);
-    free(linebuf);
-    free(next);
-    return NULL;
-  } 
-
-  next->token_listhead = malloc(sizeof(struct token_node));
-  assert(next->token_listhead);
-  curr = next->token_listhead;
-  curr->token = strdup(token);
-  curr->next = NULL;
-
-  while ((token = strtok(NULL, DELIMITERS)) != NULL) {
-    tn = malloc(sizeof(struct token_node));
-    assert(tn);
-    tn->token = strdup(token);
-    tn->next = NULL;
-    curr->next = tn;
-    curr = tn;
-    /* Handle strings. If the token starts with ", scan until closing " */
-    /* FIXME: There's a bug here, where the delimiter within the string
-     * gets eaten. It might also not be working right if there was no delim
-     * within the string. */
-    if (curr->token[0] == '\"') {
-      char *s = strtok(NULL, "\"");
-      if (s) {
-        size_t sz = strlen(curr->token) + strlen(s) + 2; /* +2 for \" and \0 */
-        curr->token = realloc(curr->token, sz);
-        assert(curr->token);
-        strcat(curr->token, s);
-        strcat(curr->token, "\""); /* restore the closing " */
-      }
-    }
+  return 1;
+}
+
+/* Fills the line array of @prog from its lexer. Returns 0 if no lines. */
+static int read_lines(struct program *prog, struct diag *diag)
+{
+  struct token_buf tb = {0};
+  size_t max_lines;
+
+  /* Every line fits in one slot of an array sized by the newline count */
+  max_lines = lexer_count_lines(&prog->lex);
+  arena_init(&prog->arena, max_lines * sizeof(struct line));
+  prog->lines = arena_alloc(&prog->arena, max_lines * sizeof(struct line));
+  if (!prog->lines) return 0;
+
+  while (prog->nlines < max_lines &&
+         get_next_line(&prog->lex, &prog->arena, &tb, diag,
+                       &prog->lines[prog->nlines])) {
+    prog->nlines++;
   }
 
-  free(linebuf);
-  return next;
+  free(tb.v);
+  return prog->nlines != 0;
 }
 
 /* Public Interface */
 
-struct line* get_lines(char *infile)
+struct program* get_lines(char *infile, struct diag *diag)
 {
-  struct line* head, *curr;
-  FILE *in = fopen(infile, "r");
+  struct program* prog = calloc(1, sizeof(struct program));
 
-#ifdef DEBUG
-  assert(in);
-#endif
+  if (!prog) return NULL;
 
-  if (!in) return NULL;
-  
-  head = get_next_line(in);
-  if (!head) return NULL;
+  if (lexer_open(&prog->lex, infile) != 0) {
+    free(prog);
+    return NULL;
+  }
 
-  curr = head;
-  do {
-    curr->next = get_next_line(in);
-    curr = curr->next;
-  } while (curr != NULL);
+  if (!read_lines(prog, diag)) {
+    free_lines(prog);
+    return NULL;
+  }
+  return prog;
+}
+
+struct program* get_lines_buffer(const char *src, size_t size,
+                                 struct diag *diag)
+{
+  struct program* prog = calloc(1, sizeof(struct program));
+
+  if (!prog) return NULL;
+
+  if (lexer_open_buffer(&prog->lex, src, size) != 0) {
+    free(prog);
+    return NULL;
+  }
+
+  if (!read_lines(prog, diag)) {
+    free_lines(prog);
+    return NULL;
+  }
+  return prog;
+}
+
+int line_reader_open(struct line_reader *r, char *infile, struct diag *diag)
+{
+  memset(r, 0, sizeof(struct line_reader));
+  r->diag = diag;
+  if (lexer_open(&r->lex, infile) != 0) return -1;
+  arena_init(&r->arena, 0);
+  return 0;
+}
+
+struct line* line_reader_next(struct line_reader *r)
+{
+  /* The previous line is done with, so is the memory behind it */
+  arena_reset(&r->arena);
+  lexer_release(&r->lex);
 
-  fclose(in);
-  return head;
+  if (!get_next_line(&r->lex, &r->arena, &r->tb, r->diag, &r->line)) {
+    return NULL;
+  }
+  return &r->line;
 }
 
-void print_lines(struct line* curr)
+void line_reader_close(struct line_reader *r)
 {
-  struct token_node* tok = NULL;
+  free(r->tb.v);
+  arena_free(&r->arena);
+  lexer_close(&r->lex);
+}
 
-  while (curr != NULL) {
+void print_line(struct line* l)
+{
+  int i;
 
 #ifdef VERBOSE
-    if (curr->type < NUM_DIRECTIVES) {
-      printf("Directive: %s\t", directives[curr->type]);
-    } else if (curr->type < NUM_DIRECTIVES + NUM_INSTS) {
-      printf("Instruction: %s\t", instructions[curr->type - NUM_DIRECTIVES]);
-    } else {
-      printf("Unknown Type: %d\t", curr->type);
-    }
+  if (l->type < NUM_DIRECTIVES) {
+    printf("Directive: %s\t", mnemonic_name(l->type));
+  } else if (l->type < NUM_LINETYPES) {
+    printf("Instruction: %s\t", mnemonic_name(l->type));
+  } else {
+    printf("Unknown Type: %d\t", l->type);
+  }
 #endif
 
-    if (curr->label) {
-      printf("%s\t", curr->label);
-    }
-
-    for (tok = curr->token_listhead; tok != NULL; tok = tok->next) {
-      printf("%s\t", tok->token);
-    }
-    printf("\n");
-    curr = curr->next;
+  if (l->label) {
+    printf("%s:\t", l->label);
   }
 
+  for (i = 0; i < l->ntokens; i++) {
+    printf("%s\t", l->tokens[i].token);
+  }
+  printf("\n");
 }
 
-void free_lines(struct line* lines_head)
+void print_lines(struct program* prog)
 {
-  struct line *curr = lines_head, *next;
-
-  while (curr != NULL) {
-    next = curr->next;
-    free_token_list(curr->token_listhead);
-    free(curr->label);
-    free(curr);
-    curr = next;
+  struct line* curr;
+
+  for (curr = prog->lines; curr < prog->lines + prog->nlines; curr++) {
+    print_line(curr);
   }
 }
 
+void free_lines(struct program* prog)
+{
+  arena_free(&prog->arena);
+  lexer_close(&prog->lex);
+  free(prog);
+}
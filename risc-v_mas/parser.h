@@ -28,89 +28,135 @@
 #ifndef PARSER_H_
 #define PARSER_H_
 
+#include "arena.h"
+#include "diag.h"
+#include "lexer.h"
+
 #include <stdint.h>
 
 typedef enum {
-  ALIGN = 0,
-  ASCIIZ = 1,
-  DATA = 2,
-  SPACE = 3,
-  TEXT = 4,
-  WORD = 5,
-  ADD = 6,
-  ADDI = 7,
-  AND = 8,
-  ANDI = 9,
-  AUIPC = 10,
-  BEQ = 11,
-  BNE = 12,
-  JAL = 13,
-  JALR = 14,
-  LUI = 15,
-  LW = 16,
-  OR = 17,
-  ORI = 18,
-  SLT = 19,
-  SLTI = 20,
-  SLL = 21,
-  SLLI = 22,
-  SRA = 23,
-  SRAI = 24,
-  SRL = 25,
-  SRLI = 26,
-  SUB = 27,
-  SW = 28,
-  XOR = 29,
-  XORI = 30,
-  ECALL = 31,
-  J = 32,
-  LA,
-  LI,
-  MV,
-  NEG,
-  NOP,
-  NOT,
-  RET
+#define DIRECTIVE(t, name) t,
+#define INSTRUCTION(t, name, ...) t,
+#define PSEUDO(t, name, ...) t,
+#include "mnemonics.def"
+#undef DIRECTIVE
+#undef INSTRUCTION
+#undef PSEUDO
+  NUM_LINETYPES
 } linetype;
 
-#define NUM_DIRECTIVES (6)
+/* Count the directives and real instructions, each one expanding to "+ 1" */
+enum {
+  NUM_DIRECTIVES = 0
+#define DIRECTIVE(t, name) + 1
+#define INSTRUCTION(t, name, ...)
+#define PSEUDO(t, name, ...)
+#include "mnemonics.def"
+#undef INSTRUCTION
+  ,
+  FIRST_PSEUDOINST = 0
+#define INSTRUCTION(t, name, ...) + 1
+#include "mnemonics.def"
+#undef DIRECTIVE
+#undef INSTRUCTION
+#undef PSEUDO
+};
+
 extern char *directives[NUM_DIRECTIVES];
 
-#define NUM_INSTS (34)
+#define NUM_INSTS (NUM_LINETYPES - NUM_DIRECTIVES)
 extern char *instructions[NUM_INSTS];
 
-#define FIRST_PSEUDOINST (J)
-
-struct token_node {
-  char *token;
-  struct token_node *next;
+/* Tokens are views into the source text, which is owned by the program */
+struct token {
+  char *token;    /* NUL-terminated token text */
+  uint32_t len;   /* Length of the token text */
 };
 
 struct line {
-  linetype type;  /* What kind of line this is */
-  char *label;    /* Assembler label, if any */
-  struct token_node* token_listhead;  /* Tokenized line */
-  struct line* next;
+  linetype type;      /* What kind of line this is */
+  uint32_t ntokens;   /* Number of entries in tokens */
+  char *label;        /* Assembler label without the ':', if any */
+  struct token *tokens;  /* Tokenized line, starting with the mnemonic */
+};
+
+/* Reusable storage for the tokens of one line, grown as needed */
+struct token_buf {
+  struct lex_token *v;
+  size_t cap;
+};
+
+/* A source file read one line at a time, keeping only the current line */
+struct line_reader {
+  struct lexer lex;   /* Holds the source text the current line refers to */
+  struct arena arena; /* Holds the tokens of the current line */
+  struct token_buf tb;  /* Scratch space for scanning a line */
+  struct diag *diag;  /* Where parse errors are reported */
+  struct line line;   /* The current line */
+};
+
+/* A parsed source file */
+struct program {
+  struct lexer lex;   /* Holds the source text the lines refer to */
+  struct arena arena; /* Holds the lines and their tokens */
+  struct line* lines; /* Array of lines in source order */
+  size_t nlines;      /* Number of entries in lines */
 };
 
 /**
- * Reads in all lines from the file named @infile.
+ * Reads in all lines from the file named @infile, reporting parse errors to
+ * @diag.
  *
- * Returns an array of allocated and populated struct line objects.
+ * Returns an allocated program with an array of populated struct line objects.
+ * The lines and the tokens they refer to are laid out contiguously, in source
+ * order, in the program's arena.
  *
  * Returns NULL if an error occurred.
  */
-struct line* get_lines(char *infile);
+struct program* get_lines(char *infile, struct diag *diag);
+
+/**
+ * Like get_lines, but reads the @size bytes of source text at @src.
+ */
+struct program* get_lines_buffer(const char *src, size_t size,
+                                 struct diag *diag);
+
+/**
+ * Opens the file named @infile for reading with line_reader_next. Parse errors
+ * are reported to @diag.
+ *
+ * Returns 0 on success, or -1 if the file could not be opened.
+ */
+int line_reader_open(struct line_reader *r, char *infile, struct diag *diag);
+
+/**
+ * Reads the next line from @r. The line, its label and its tokens stay valid
+ * only until the next call, so the memory used does not grow with the size
+ * of the source.
+ *
+ * Returns NULL if no more lines or error occurred.
+ */
+struct line* line_reader_next(struct line_reader *r);
+
+/**
+ * Frees all the memory allocated by the reader @r.
+ */
+void line_reader_close(struct line_reader *r);
+
+/**
+ * Prints the line @l to stdout, for debugging.
+ */
+void print_line(struct line* l);
 
 /**
- * Prints the lines to stdout, for debugging.
+ * Prints the lines of @prog to stdout, for debugging.
  */
-void print_lines(struct line* lines_head);
+void print_lines(struct program* prog);
 
 /**
- * Frees all the memory allocated by the list of lines starting at head.
+ * Frees all the memory allocated by the program @prog, including its lines.
  */
-void free_lines(struct line* lines_head);
+void free_lines(struct program* prog);
 
 #endif /* PARSER_H_ */
 
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "regs.h"
+
+const char *const reg_names[NUM_REGS] = {
+  "zero",
+  "ra",
+  "sp",
+  "gp",
+  "tp",
+  "t0",
+  "t1",
+  "t2",
+  "s0",
+  "s1",
+  "a0",
+  "a1",
+  "a2",
+  "a3",
+  "a4",
+  "a5",
+  "a6",
+  "a7",
+  "s2",
+  "s3",
+  "s4",
+  "s5",
+  "s6",
+  "s7",
+  "s8",
+  "s9",
+  "s10",
+  "s11",
+  "t3",
+  "t4",
+  "t5",
+  "t6"
+};
+
+/* Private Helpers */
+
+/* Returns the value of the 1 or 2 decimal digits at @s, or -1. */
+static int get_number(const char *s, size_t len)
+{
+  if (len == 1 && s[0] >= '0' && s[0] <= '9') return s[0] - '0';
+  if (len == 2 && s[0] >= '1' && s[0] <= '9' && s[1] >= '0' && s[1] <= '9') {
+    return 10*(s[0] - '0') + (s[1] - '0');
+  }
+  return -1;
+}
+
+/* Public Interface */
+
+int reg_lookup(const char *s, size_t len)
+{
+  int n;
+
+  if (len < 2 || len > 4) return -1;
+
+  /* Every name is decided by its first character and its number, if any */
+  n = get_number(s + 1, len - 1);
+  switch (s[0]) {
+    case 'x':
+      return n < NUM_REGS ? n : -1;
+
+    case 'a':
+      return n >= 0 && n <= 7 ? 10 + n : -1;
+
+    case 's':
+      if (n == 0 || n == 1) return 8 + n;
+      if (n >= 2 && n <= 11) return 16 + n;
+      return len == 2 && s[1] == 'p' ? 2 : -1;
+
+    case 't':
+      if (n >= 0 && n <= 2) return 5 + n;
+      if (n >= 3 && n <= 6) return 25 + n;
+      return len == 2 && s[1] == 'p' ? 4 : -1;
+
+    case 'r':
+      return len == 2 && s[1] == 'a' ? 1 : -1;
+
+    case 'g':
+      return len == 2 && s[1] == 'p' ? 3 : -1;
+
+    case 'f':
+      return len == 2 && s[1] == 'p' ? 8 : -1;
+
+    case 'z':
+      return len == 4 && s[1] == 'e' && s[2] == 'r' && s[3] == 'o' ? 0 : -1;
+  }
+
+  return -1;
+}
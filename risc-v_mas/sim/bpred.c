@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bpred.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Private Helpers */
+
+static const char *const names[BPRED_NKINDS] = {
+  [BPRED_NOT_TAKEN] = "nt",
+  [BPRED_BTFN] = "btfn",
+  [BPRED_BIMODAL] = "bimodal",
+  [BPRED_GSHARE] = "gshare",
+  [BPRED_TOURNAMENT] = "tournament",
+};
+
+/* Moves the 2-bit counter @c towards @up */
+static void train(uint8_t *c, int up)
+{
+  if (up && *c < 3) (*c)++;
+  if (!up && *c > 0) (*c)--;
+}
+
+/* Returns a table of 2^@bits counters, all at 1 */
+static uint8_t *new_table(unsigned bits)
+{
+  uint8_t *t = malloc((size_t)1 << bits);
+
+  if (t) memset(t, 1, (size_t)1 << bits);
+  return t;
+}
+
+/* Public Interface */
+
+int bpred_init(struct bpred *bp, const struct bpred_config *config)
+{
+  memset(bp, 0, sizeof(struct bpred));
+  bp->config = *config;
+  if (bp->config.history_bits > 32) bp->config.history_bits = 32;
+
+  switch (config->kind) {
+    case BPRED_TOURNAMENT:
+      if (!(bp->chooser = new_table(config->table_bits))) goto oom;
+      /* fallthrough */
+    case BPRED_GSHARE:
+      if (!(bp->gshare = new_table(config->table_bits))) goto oom;
+      break;
+    default:
+      break;
+  }
+  if (config->kind == BPRED_BIMODAL || config->kind == BPRED_TOURNAMENT) {
+    if (!(bp->bimodal = new_table(config->table_bits))) goto oom;
+  }
+  if (config->ras_size) {
+    if (!(bp->ras = calloc(config->ras_size, sizeof(uint32_t)))) goto oom;
+  }
+  return 0;
+
+oom:
+  bpred_free(bp);
+  return -1;
+}
+
+int bpred_branch(struct bpred *bp, uint32_t pc, uint32_t target, int taken)
+{
+  uint32_t mask = ((uint32_t)1 << bp->config.table_bits) - 1;
+  uint32_t hmask = bp->config.history_bits < 32
+                   ? ((uint32_t)1 << bp->config.history_bits) - 1 : ~0U;
+  uint32_t i = (pc >> 2) & mask;
+  uint32_t g = ((pc >> 2) ^ (bp->history & hmask)) & mask;
+  int pred, b = 0, s = 0;
+
+  switch (bp->config.kind) {
+    case BPRED_BTFN:
+      pred = target < pc;
+      break;
+    case BPRED_BIMODAL:
+      pred = bp->bimodal[i] >= 2;
+      break;
+    case BPRED_GSHARE:
+      pred = bp->gshare[g] >= 2;
+      break;
+    case BPRED_TOURNAMENT:
+      b = bp->bimodal[i] >= 2;
+      s = bp->gshare[g] >= 2;
+      pred = bp->chooser[i] >= 2 ? s : b;
+      break;
+    default:
+      pred = 0;
+  }
+
+  /* Train as though the branch resolves before the next one is predicted */
+  if (bp->bimodal) train(&bp->bimodal[i], taken);
+  if (bp->gshare) train(&bp->gshare[g], taken);
+  if (bp->chooser && b != s) train(&bp->chooser[i], s == taken);
+  bp->history = bp->history << 1 | (taken != 0);
+
+  bp->stats.branches++;
+  if (pred == taken) bp->stats.branch_hits++;
+  return pred == taken;
+}
+
+void bpred_call(struct bpred *bp, uint32_t link)
+{
+  if (!bp->ras) return;
+  bp->ras_top = (bp->ras_top + 1) % bp->config.ras_size;
+  bp->ras[bp->ras_top] = link;
+  if (bp->ras_count < bp->config.ras_size) bp->ras_count++;
+}
+
+int bpred_return(struct bpred *bp, uint32_t target)
+{
+  uint32_t pred;
+
+  if (!bp->ras) return 0;
+  bp->stats.returns++;
+  if (!bp->ras_count) return 0;
+
+  pred = bp->ras[bp->ras_top];
+  bp->ras_top = (bp->ras_top + bp->config.ras_size - 1) % bp->config.ras_size;
+  bp->ras_count--;
+  if (pred != target) return 0;
+  bp->stats.return_hits++;
+  return 1;
+}
+
+const char *bpred_name(enum bpred_kind kind)
+{
+  return kind < BPRED_NKINDS ? names[kind] : NULL;
+}
+
+void bpred_free(struct bpred *bp)
+{
+  free(bp->bimodal);
+  free(bp->gshare);
+  free(bp->chooser);
+  free(bp->ras);
+  bp->bimodal = bp->gshare = bp->chooser = NULL;
+  bp->ras = NULL;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BPRED_H_
+#define BPRED_H_
+
+#include <stdint.h>
+
+/* Ways to predict the direction of beq and bne */
+enum bpred_kind {
+  BPRED_NOT_TAKEN,    /* Always falls through */
+  BPRED_BTFN,         /* Backward taken, forward not taken */
+  BPRED_BIMODAL,      /* 2-bit counter per pc */
+  BPRED_GSHARE,       /* 2-bit counter per pc xor global history */
+  BPRED_TOURNAMENT,   /* Bimodal and gshare, with a 2-bit chooser per pc */
+  BPRED_NKINDS
+};
+
+/* The shape of a predictor */
+struct bpred_config {
+  enum bpred_kind kind;
+  unsigned table_bits;    /* log2 of the entries in each counter table */
+  unsigned history_bits;  /* Global history kept for gshare, at most 32 */
+  unsigned ras_size;      /* Return address stack entries, 0 for none */
+};
+
+/* How well a predictor did */
+struct bpred_stats {
+  uint64_t branches;      /* beq and bne predicted */
+  uint64_t branch_hits;
+  uint64_t returns;       /* Returns predicted from the stack */
+  uint64_t return_hits;
+};
+
+/* A branch predictor and return address stack */
+struct bpred {
+  struct bpred_config config;
+  struct bpred_stats stats;
+  uint8_t *bimodal;       /* 2-bit counters, taken from 2 up */
+  uint8_t *gshare;
+  uint8_t *chooser;       /* For tournament: gshare from 2 up */
+  uint32_t history;       /* Latest outcome in bit 0 */
+  uint32_t *ras;          /* Circular: overflow drops the oldest */
+  unsigned ras_top;
+  unsigned ras_count;
+};
+
+/**
+ * Sets up @bp as a predictor shaped by @config, with every counter weakly
+ * not taken.
+ *
+ * Returns 0 on success, or -1 if out of memory.
+ */
+int bpred_init(struct bpred *bp, const struct bpred_config *config);
+
+/**
+ * Predicts whether the beq or bne at @pc, branching to @target, is taken,
+ * then trains on whether it was, @taken.
+ *
+ * Returns 1 if the prediction was right.
+ */
+int bpred_branch(struct bpred *bp, uint32_t pc, uint32_t target, int taken);
+
+/**
+ * Pushes the return address @link of a call, a jal or jalr that writes ra.
+ */
+void bpred_call(struct bpred *bp, uint32_t link);
+
+/**
+ * Predicts the target of a return, a jalr through ra that does not link, by
+ * popping the stack, and compares it with where the return went, @target.
+ *
+ * Returns 1 if the prediction was right; 0 if it was wrong or the stack was
+ * empty or absent.
+ */
+int bpred_return(struct bpred *bp, uint32_t target);
+
+/**
+ * Returns the name of @kind, as msim takes it, or NULL.
+ */
+const char *bpred_name(enum bpred_kind kind);
+
+/**
+ * Frees the tables of @bp.
+ */
+void bpred_free(struct bpred *bp);
+
+#endif /* BPRED_H_ */
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * msim: runs a program assembled by mas and reports how it ended, optionally
+ * timing it on the 5-stage pipeline model.
+ */
+
+#include "pipe.h"
+#include "sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+void usage(char *name)
+{
+  printf("Usage: %s [-n steps] [-m bytes] [-s] [-F] [-p] [-f paths] \
+[-b stage] [-P predictor] [-t bits] [-g bits] [-r entries] [input program]\n\
+where:\n\
+\t-n stops after about this many instructions (default: no limit).\n\
+\t-m sets the bytes of data memory, with an optional k or M suffix\n\
+\t   (default: %d).\n\
+\t-s prints the instructions run and the speed to stderr.\n\
+\t-F runs without fusing instruction pairs into superinstructions.\n\
+\t-p runs on the pipeline model and prints its counters to stderr.\n\
+\t-f sets its forwarding paths: any of x (EX/MEM to EX), m (MEM/WB to EX)\n\
+\t   and d (EX/MEM to a branch in ID), or none (default: xmd).\n\
+\t-b sets the stage where branches and jalr resolve: id, ex or mem\n\
+\t   (default: ex).\n\
+\t-P sets the branch predictor: nt, btfn, bimodal, gshare or tournament\n\
+\t   (default: nt).\n\
+\t-t sets log2 of the entries in its counter tables (default: 10).\n\
+\t-g sets the bits of global history gshare uses (default: 10).\n\
+\t-r sets the entries of the return address stack (default: 0, none).\n\
+\t[input program] is a .mxe, flat or ELF image, as written by mas.\n",
+    name, SIM_DATA_SIZE);
+  exit(1);
+}
+
+/* Parses a memory size such as 4096, 64k or 2M, as mas -d and -t do.
+ * Returns 0 if invalid. */
+static uint32_t parse_size(char *s, uint32_t max)
+{
+  char *end;
+  unsigned long n = strtoul(s, &end, 0);
+
+  if (*end == 'k' || *end == 'K') {
+    n *= 1024;
+    end++;
+  } else if (*end == 'm' || *end == 'M') {
+    n *= 1024*1024;
+    end++;
+  }
+  if (*end != '\0' || n > max) return 0;
+  return n;
+}
+
+/* Parses the -f argument @arg into enum pipe_forward bits */
+unsigned parse_forward(char *name, const char *arg)
+{
+  unsigned fwd = 0;
+
+  if (!strcmp(arg, "none")) return 0;
+  for (; *arg; arg++) {
+    switch (*arg) {
+      case 'x': fwd |= PIPE_FWD_EX; break;
+      case 'm': fwd |= PIPE_FWD_MEM; break;
+      case 'd': fwd |= PIPE_FWD_ID; break;
+      default: usage(name);
+    }
+  }
+  return fwd;
+}
+
+/* Parses the -b argument @arg into a stage */
+enum pipe_stage parse_stage(char *name, const char *arg)
+{
+  if (!strcmp(arg, "id")) return PIPE_ID;
+  if (!strcmp(arg, "ex")) return PIPE_EX;
+  if (!strcmp(arg, "mem")) return PIPE_MEM;
+  usage(name);
+  return PIPE_EX;
+}
+
+/* Parses the -P argument @arg into a predictor kind */
+enum bpred_kind parse_predictor(char *name, const char *arg)
+{
+  int k;
+
+  for (k = 0; k < BPRED_NKINDS; k++) {
+    if (!strcmp(arg, bpred_name(k))) return k;
+  }
+  usage(name);
+  return BPRED_NOT_TAKEN;
+}
+
+int main(int argc, char *argv[])
+{
+  struct image img;
+  struct sim m;
+  struct pipe p;
+  struct pipe_config config = {PIPE_FWD_ALL, PIPE_EX,
+                               {BPRED_NOT_TAKEN, 10, 10, 0}};
+  struct timespec t0, t1;
+  const char *why;
+  uint64_t max_steps = 0;
+  uint32_t data_size = SIM_DATA_SIZE;
+  enum sim_stop stop;
+  double secs;
+  int opt, stats = 0, timed = 0, fuse = 1, ret;
+
+  while ((opt = getopt(argc, argv, "n:m:sFpf:b:P:t:g:r:")) != -1) {
+    switch (opt) {
+      case 'n':
+        max_steps = strtoull(optarg, NULL, 0);
+        break;
+      case 'm':
+        /* Data memory must fit between its usual start and the top */
+        data_size = parse_size(optarg, 0 - IMAGE_DATA_BEGIN);
+        if (!data_size) usage(argv[0]);
+        break;
+      case 's':
+        stats = 1;
+        break;
+      case 'F':
+        fuse = 0;
+        break;
+      case 'p':
+        timed = 1;
+        break;
+      case 'f':
+        config.forward = parse_forward(argv[0], optarg);
+        break;
+      case 'b':
+        config.branch_stage = parse_stage(argv[0], optarg);
+        break;
+      case 'P':
+        config.predictor.kind = parse_predictor(argv[0], optarg);
+        break;
+      case 't':
+        config.predictor.table_bits = atoi(optarg);
+        if (config.predictor.table_bits > 24) usage(argv[0]);
+        break;
+      case 'g':
+        config.predictor.history_bits = atoi(optarg);
+        if (config.predictor.history_bits > 32) usage(argv[0]);
+        break;
+      case 'r':
+        config.predictor.ras_size = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind >= argc) usage(argv[0]);
+
+  if (image_open(&img, argv[optind], &why)) {
+    fprintf(stderr, "%s: %s\n", argv[optind], why);
+    return 1;
+  }
+  if (sim_init(&m, &img, data_size)) {
+    fprintf(stderr, "%s: does not fit in %u bytes of memory\n",
+            argv[optind], data_size);
+    return 1;
+  }
+  image_close(&img);
+  m.max_steps = max_steps;
+  m.fuse = fuse;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if (timed) {
+    if (pipe_init(&p, &m, &config)) {
+      fprintf(stderr, "%s: out of memory\n", argv[0]);
+      return 1;
+    }
+    stop = pipe_run(&p);
+  } else {
+    stop = sim_run(&m);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  fflush(m.out);
+
+  switch (stop) {
+    case SIM_EXIT:
+      ret = m.status;
+      break;
+    case SIM_FAULT:
+      fprintf(stderr, "fault at 0x%.8X: %s\n", m.fault_pc, m.fault);
+      ret = 2;
+      break;
+    default:
+      fprintf(stderr, "stopped at 0x%.8X after %llu instructions\n", m.pc,
+              (unsigned long long)m.steps);
+      ret = 3;
+  }
+
+  if (timed) {
+    pipe_print_stats(&p, stderr);
+    pipe_free(&p);
+  }
+  if (stats) {
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "%llu instructions in %.3f s (%.1f MIPS)\n",
+            (unsigned long long)m.steps, secs,
+            secs > 0 ? m.steps / secs / 1e6 : 0.0);
+    if (!timed) {
+      fprintf(stderr, "%llu dispatches (%.3f per instruction)\n",
+              (unsigned long long)m.dispatches,
+              m.steps ? (double)m.dispatches / m.steps : 0.0);
+    }
+  }
+  sim_free(&m);
+  return ret;
+}
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pipe.h"
+
+#include <string.h>
+
+/* Private Helpers */
+
+/* Returns 1 if the instruction in @s writes register @r */
+static int writes(const struct pipe_slot *s, uint8_t r)
+{
+  return s->valid && s->dest == r;
+}
+
+/* Works out what the instruction traced in @s reads, writes and redirects */
+static void classify(struct pipe *p, struct pipe_slot *s)
+{
+  const struct decoded_insn *d = &s->t.insn;
+  int taken;
+
+  switch (d->format) {
+    case FMT_R:
+      s->src[0] = d->rs1;
+      s->src[1] = d->rs2;
+      s->dest = d->rd;
+      break;
+    case FMT_I:
+      s->src[0] = d->rs1;
+      s->dest = d->rd;
+      break;
+    case FMT_S:
+    case FMT_SB:
+      s->src[0] = d->rs1;
+      s->src[1] = d->rs2;
+      break;
+    case FMT_U:
+    case FMT_UJ:
+      s->dest = d->rd;
+      break;
+  }
+  s->load = d->op == INSN_LW;
+
+  switch (d->op) {
+    case INSN_ECALL:
+      /* The service number and its argument */
+      s->src[0] = 17;
+      s->src[1] = 10;
+      break;
+    case INSN_BEQ:
+    case INSN_BNE:
+      taken = s->t.next_pc != s->t.pc + 4;
+      p->stats.branches++;
+      if (taken) p->stats.taken++;
+      s->early = p->config.branch_stage == PIPE_ID;
+      if (!bpred_branch(&p->bp, s->t.pc, s->t.pc + d->imm, taken)) {
+        s->redirect = 1;
+        s->resolve = p->config.branch_stage;
+        s->mispredicted = 1;
+      } else if (taken) {
+        s->redirect = 1;
+        s->resolve = PIPE_ID;
+      }
+      break;
+    case INSN_JALR:
+      s->redirect = s->t.next_pc != s->t.pc + 4;
+      s->resolve = p->config.branch_stage;
+      s->early = p->config.branch_stage == PIPE_ID;
+      if (d->rd == 0 && d->rs1 == 1 && p->bp.ras) {
+        if (bpred_return(&p->bp, s->t.next_pc)) s->resolve = PIPE_ID;
+        else s->mispredicted = 1;
+      }
+      if (d->rd == 1) bpred_call(&p->bp, s->t.pc + 4);
+      break;
+    case INSN_JAL:
+      /* The target is known once decoded */
+      s->redirect = s->t.next_pc != s->t.pc + 4;
+      s->resolve = PIPE_ID;
+      if (d->rd == 1) bpred_call(&p->bp, s->t.pc + 4);
+      break;
+  }
+}
+
+/*
+ * Fetches the next instruction. After an instruction whose next pc fetch
+ * cannot know yet, it brings in wrong-path slots until that one resolves.
+ */
+static struct pipe_slot fetch(struct pipe *p)
+{
+  struct pipe_slot s;
+
+  memset(&s, 0, sizeof(struct pipe_slot));
+  if (p->fetch_wrong) {
+    s.wrong_path = 1;
+    return s;
+  }
+  if (p->stop != SIM_RUNNING) return s;
+
+  p->stop = sim_step(p->m, &s.t);
+  if (p->stop != SIM_RUNNING && p->stop != SIM_EXIT) return s;
+
+  s.valid = 1;
+  classify(p, &s);
+  if (s.redirect) p->fetch_wrong = 1;
+  return s;
+}
+
+/*
+ * Checks whether the instruction in ID can move on to EX this cycle, given
+ * the instructions ahead of it. Results reach the register file in WB, which
+ * writes in the first half of the cycle and is read in the second; before
+ * then only the forwarding paths of the config can carry them.
+ *
+ * Returns the enum pipe_stall that holds it back, or -1 if none does.
+ */
+static int hazard(const struct pipe *p)
+{
+  const struct pipe_slot *id = &p->stage[PIPE_ID];
+  const struct pipe_slot *ex = &p->stage[PIPE_EX];
+  const struct pipe_slot *mem = &p->stage[PIPE_MEM];
+  unsigned fwd = p->config.forward;
+  uint8_t r;
+  int i;
+
+  if (!id->valid) return -1;
+
+  for (i = 0; i < 2; i++) {
+    if (!(r = id->src[i])) continue;
+
+    /* The youngest writer of r is the one that counts */
+    if (id->early) {
+      /* Compared in ID: only a finished ALU result can be forwarded */
+      if (writes(ex, r)) return PIPE_STALL_BRANCH;
+      if (writes(mem, r) && (mem->load || !(fwd & PIPE_FWD_ID))) {
+        return PIPE_STALL_BRANCH;
+      }
+    } else if (writes(ex, r)) {
+      if (ex->load) return PIPE_STALL_LOAD_USE;
+      if (!(fwd & PIPE_FWD_EX)) return PIPE_STALL_DATA;
+    } else if (writes(mem, r) && !(fwd & PIPE_FWD_MEM)) {
+      return PIPE_STALL_DATA;
+    }
+  }
+  return -1;
+}
+
+/*
+ * Squashes the wrong-path slots behind the jump in @k, which is finishing its
+ * resolving stage, so that the next fetch is from the right place.
+ */
+static void flush(struct pipe *p, int k)
+{
+  struct pipe_slot *s = p->stage;
+  uint64_t squashed = 0;
+  int j;
+
+  for (j = 0; j < k; j++) {
+    if (!s[j].wrong_path) continue;
+    memset(&s[j], 0, sizeof(struct pipe_slot));
+    squashed++;
+  }
+  p->stats.squashed += squashed;
+  p->fetch_wrong = 0;
+
+  if (s[k].mispredicted) {
+    p->stats.mispredicts++;
+    p->stats.mispredict_squashed += squashed;
+  }
+
+  switch (s[k].t.insn.op) {
+    case INSN_JAL:
+      p->stats.flushes[PIPE_FLUSH_JAL]++;
+      break;
+    case INSN_JALR:
+      p->stats.flushes[PIPE_FLUSH_JALR]++;
+      break;
+    default:
+      p->stats.flushes[PIPE_FLUSH_BRANCH]++;
+  }
+}
+
+/* Clocks the pipeline once; the stages then hold what they work on */
+static void cycle(struct pipe *p)
+{
+  struct pipe_slot *s = p->stage;
+  int stall = hazard(p), k;
+
+  p->stats.cycles++;
+
+  /* A jump redirects fetch as it leaves its resolving stage */
+  for (k = PIPE_ID; k < PIPE_WB; k++) {
+    if (!s[k].valid || !s[k].redirect || s[k].resolve != k) continue;
+    if (k == PIPE_ID && stall >= 0) continue;
+    flush(p, k);
+  }
+
+  s[PIPE_WB] = s[PIPE_MEM];
+  s[PIPE_MEM] = s[PIPE_EX];
+  if (stall >= 0) {
+    memset(&s[PIPE_EX], 0, sizeof(struct pipe_slot));
+    p->stats.stalls[stall]++;
+  } else {
+    s[PIPE_EX] = s[PIPE_ID];
+    s[PIPE_ID] = s[PIPE_IF];
+    s[PIPE_IF] = fetch(p);
+  }
+  if (s[PIPE_WB].valid) p->stats.insns++;
+}
+
+/* Returns 1 while any stage before WB holds something */
+static int busy(const struct pipe *p)
+{
+  int k;
+
+  for (k = PIPE_IF; k < PIPE_WB; k++) {
+    if (p->stage[k].valid || p->stage[k].wrong_path) return 1;
+  }
+  return 0;
+}
+
+/* Returns @n as a percentage of @of */
+static double percent(uint64_t n, uint64_t of)
+{
+  return of ? 100.0 * n / of : 0.0;
+}
+
+/* Public Interface */
+
+int pipe_init(struct pipe *p, struct sim *m, const struct pipe_config *config)
+{
+  memset(p, 0, sizeof(struct pipe));
+  p->config = *config;
+  p->m = m;
+  p->stop = SIM_RUNNING;
+  return bpred_init(&p->bp, &config->predictor);
+}
+
+enum sim_stop pipe_run(struct pipe *p)
+{
+  while (p->stop == SIM_RUNNING || busy(p)) cycle(p);
+  return p->stop;
+}
+
+void pipe_print_stats(const struct pipe *p, FILE *out)
+{
+  const struct pipe_stats *s = &p->stats;
+  const struct bpred *bp = &p->bp;
+  const struct bpred_stats *bs = &bp->stats;
+
+  fprintf(out, "cycles        %llu\n", (unsigned long long)s->cycles);
+  fprintf(out, "instructions  %llu\n", (unsigned long long)s->insns);
+  fprintf(out, "CPI           %.3f\n",
+          s->insns ? (double)s->cycles / s->insns : 0.0);
+  fprintf(out, "stalls        load-use %llu, data %llu, branch %llu\n",
+          (unsigned long long)s->stalls[PIPE_STALL_LOAD_USE],
+          (unsigned long long)s->stalls[PIPE_STALL_DATA],
+          (unsigned long long)s->stalls[PIPE_STALL_BRANCH]);
+  fprintf(out, "flushes       branch %llu, jal %llu, jalr %llu "
+               "(%llu instructions squashed)\n",
+          (unsigned long long)s->flushes[PIPE_FLUSH_BRANCH],
+          (unsigned long long)s->flushes[PIPE_FLUSH_JAL],
+          (unsigned long long)s->flushes[PIPE_FLUSH_JALR],
+          (unsigned long long)s->squashed);
+  fprintf(out, "branches      %llu, %llu taken\n",
+          (unsigned long long)s->branches, (unsigned long long)s->taken);
+
+  fprintf(out, "predictor     %s", bpred_name(bp->config.kind));
+  if (bp->bimodal || bp->gshare) {
+    fprintf(out, ", %u entries", 1U << bp->config.table_bits);
+  }
+  if (bp->gshare) fprintf(out, ", %u history bits", bp->config.history_bits);
+  fprintf(out, ", %u return stack entries\n", bp->config.ras_size);
+  fprintf(out, "branch hits   %llu of %llu (%.2f%%)\n",
+          (unsigned long long)bs->branch_hits,
+          (unsigned long long)bs->branches, percent(bs->branch_hits,
+                                                     bs->branches));
+  fprintf(out, "return hits   %llu of %llu (%.2f%%)\n",
+          (unsigned long long)bs->return_hits,
+          (unsigned long long)bs->returns, percent(bs->return_hits,
+                                                    bs->returns));
+  fprintf(out, "mispredicts   %llu, costing %llu cycles (%.2f each)\n",
+          (unsigned long long)s->mispredicts,
+          (unsigned long long)s->mispredict_squashed,
+          s->mispredicts ? (double)s->mispredict_squashed / s->mispredicts
+                         : 0.0);
+}
+
+void pipe_free(struct pipe *p)
+{
+  bpred_free(&p->bp);
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PIPE_H_
+#define PIPE_H_
+
+#include "bpred.h"
+#include "sim.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Stages of the pipeline, oldest last */
+enum pipe_stage {
+  PIPE_IF,
+  PIPE_ID,
+  PIPE_EX,
+  PIPE_MEM,
+  PIPE_WB,
+  PIPE_NSTAGES
+};
+
+/* Forwarding paths, to or together in pipe_config.forward */
+enum pipe_forward {
+  PIPE_FWD_EX  = 1,   /* EX/MEM latch to the inputs of EX */
+  PIPE_FWD_MEM = 2,   /* MEM/WB latch to the inputs of EX */
+  PIPE_FWD_ID  = 4,   /* EX/MEM latch to the comparator of a branch in ID */
+  PIPE_FWD_ALL = 7
+};
+
+/* Why the instruction in ID waited a cycle */
+enum pipe_stall {
+  PIPE_STALL_LOAD_USE,  /* Needs the result of the load ahead of it */
+  PIPE_STALL_DATA,      /* Needs a result that no forwarding path carries */
+  PIPE_STALL_BRANCH,    /* A branch resolving in ID needs a result not ready */
+  PIPE_NSTALLS
+};
+
+/* What redirected fetch, squashing the instructions fetched after it */
+enum pipe_flush {
+  PIPE_FLUSH_BRANCH,    /* Taken beq or bne */
+  PIPE_FLUSH_JAL,
+  PIPE_FLUSH_JALR,
+  PIPE_NFLUSHES
+};
+
+/* The shape of the pipeline */
+struct pipe_config {
+  unsigned forward;             /* enum pipe_forward bits */
+  enum pipe_stage branch_stage; /* Where beq, bne and jalr resolve:
+                                   PIPE_ID, PIPE_EX or PIPE_MEM */
+  struct bpred_config predictor;
+};
+
+/* Counters of a run */
+struct pipe_stats {
+  uint64_t cycles;
+  uint64_t insns;               /* Instructions retired */
+  uint64_t stalls[PIPE_NSTALLS];
+  uint64_t flushes[PIPE_NFLUSHES];
+  uint64_t squashed;            /* Instructions flushed, one bubble each */
+  uint64_t branches;            /* beq and bne */
+  uint64_t taken;
+  uint64_t mispredicts;         /* Branches and returns predicted wrong */
+  uint64_t mispredict_squashed; /* The instructions they squashed */
+};
+
+/* An instruction in flight */
+struct pipe_slot {
+  uint8_t valid;                /* 0 for a bubble */
+  uint8_t wrong_path;           /* Fetched after a jump, before it redirected */
+  uint8_t redirect;             /* Fetch goes astray after it until resolve */
+  uint8_t resolve;              /* Stage where it puts fetch right */
+  uint8_t mispredicted;
+  uint8_t dest;                 /* Register written, 0 for none */
+  uint8_t src[2];               /* Registers read, 0 for none */
+  uint8_t early;                /* Reads its sources in ID, not EX */
+  uint8_t load;
+  struct sim_trace t;
+};
+
+/* The timing model, driving a functional simulator */
+struct pipe {
+  struct pipe_config config;
+  struct pipe_stats stats;
+  struct pipe_slot stage[PIPE_NSTAGES];
+  struct bpred bp;
+  struct sim *m;
+  enum sim_stop stop;           /* Why the program stopped, SIM_RUNNING till */
+  uint8_t fetch_wrong;          /* Fetching the wrong path */
+};
+
+/**
+ * Sets up @p to time the program of @m, which should be freshly loaded, on a
+ * pipeline shaped by @config.
+ *
+ * Fetch is steered by the branch predictor of the config. A beq or bne
+ * predicted taken, a jal and a return predicted by the return address stack
+ * redirect fetch from ID, where their target is known, at the cost of one
+ * bubble. A misprediction, and a jalr that was not predicted, is put right
+ * in the branch stage.
+ *
+ * Returns 0 on success, or -1 if out of memory.
+ */
+int pipe_init(struct pipe *p, struct sim *m, const struct pipe_config *config);
+
+/**
+ * Runs the program, a cycle at a time, until it stops and the pipeline has
+ * drained. The program runs in the functional simulator, which the pipeline
+ * fetches from, so a fault or limit stops it the same way as sim_run.
+ *
+ * Returns why the program stopped.
+ */
+enum sim_stop pipe_run(struct pipe *p);
+
+/**
+ * Prints the counters of @p, and of its predictor, to @out.
+ */
+void pipe_print_stats(const struct pipe *p, FILE *out);
+
+/**
+ * Frees the predictor of @p.
+ */
+void pipe_free(struct pipe *p);
+
+#endif /* PIPE_H_ */
@@ -0,0 +1,627 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sim.h"
+#include "decode.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Private Helpers */
+/* Most instructions in a block; longer straight lines are split */
+#define BLOCK_MAX 64
+
+/* Bytes the block arena grows by */
+#define BLOCK_ARENA_CHUNK (256*1024)
+
+/* What each pre-decoded op does; its handler in sim_run */
+enum sim_kind {
+  K_ADD, K_SUB, K_SLL, K_SLT, K_XOR, K_SRL, K_SRA, K_OR, K_AND,
+  K_ADDI, K_SLTI, K_XORI, K_ORI, K_ANDI, K_SLLI, K_SRLI, K_SRAI,
+  K_LUI,            /* Also auipc, whose value is known when decoding */
+  K_LW, K_SW,
+  K_BEQ, K_BNE, K_JAL, K_JALR,
+  K_ECALL,
+  K_ILLEGAL,
+  K_NEXT,           /* Ends a block that was cut short: goes on to the next */
+  K_ADDI_BEQ, K_ADDI_BNE,       /* Compare and branch, fused by translate */
+  K_SLT_BEQ, K_SLT_BNE,
+  K_SLTI_BEQ, K_SLTI_BNE,
+  NUM_KINDS
+};
+
+/*
+ * An instruction decoded once, ahead of running it. Writes to x0 go to x[32]
+ * instead, so that no handler has to check for it. The immediate of a branch
+ * or jal is its target address. A fused op stands for more than one
+ * instruction and is placed at the first.
+ */
+struct sim_op {
+  const void *handler;
+  uint8_t rd;
+  uint8_t rs1;
+  uint8_t rs2;
+  uint8_t at;               /* Index of its instruction in the block */
+  int32_t imm;
+};
+
+/*
+ * Straight-line code decoded once, from its first instruction to a jump, an
+ * illegal word, the end of text or BLOCK_MAX instructions. The last op leaves
+ * the block; next remembers the blocks it went on to, so that a hot loop
+ * chains from block to block without looking them up.
+ *
+ * Unless m->fuse is off, common pairs become superinstructions: the lui or
+ * auipc and addi of li and la load the whole constant in one op, and an addi,
+ * slt or slti before a beq or bne runs into the branch without a dispatch.
+ */
+struct sim_block {
+  uint32_t pc;
+  uint32_t n;                   /* Instructions, not counting K_NEXT */
+  uint32_t dispatches;          /* Ops dispatched to run it through */
+  struct sim_block *next[2];    /* Taken and fall-through successors */
+  struct sim_op ops[];
+};
+
+static const uint8_t kind_of[NUM_INSN_OPS] = {
+  [INSN_UNKNOWN] = K_ILLEGAL,
+  [INSN_ADD] = K_ADD, [INSN_SUB] = K_SUB, [INSN_SLL] = K_SLL,
+  [INSN_SLT] = K_SLT, [INSN_XOR] = K_XOR, [INSN_SRL] = K_SRL,
+  [INSN_SRA] = K_SRA, [INSN_OR] = K_OR, [INSN_AND] = K_AND,
+  [INSN_ADDI] = K_ADDI, [INSN_SLTI] = K_SLTI, [INSN_XORI] = K_XORI,
+  [INSN_ORI] = K_ORI, [INSN_ANDI] = K_ANDI, [INSN_SLLI] = K_SLLI,
+  [INSN_SRLI] = K_SRLI, [INSN_SRAI] = K_SRAI,
+  [INSN_LUI] = K_LUI, [INSN_AUIPC] = K_LUI,
+  [INSN_LW] = K_LW, [INSN_SW] = K_SW,
+  [INSN_BEQ] = K_BEQ, [INSN_BNE] = K_BNE, [INSN_JAL] = K_JAL,
+  [INSN_JALR] = K_JALR, [INSN_ECALL] = K_ECALL,
+};
+
+/* Returns 1 if @addr is the address of a word of text */
+static int in_text(const struct sim *m, uint32_t addr)
+{
+  return addr - m->text_addr < m->text_size && addr % 4 == 0;
+}
+
+
+/* Decodes the instruction of @m at @pc into @op; returns its enum sim_kind */
+static unsigned decode_op(struct sim *m, uint32_t pc, struct sim_op *op,
+                          const void *const *handlers)
+{
+  uint32_t word;
+  struct decoded_insn d;
+  unsigned kind;
+
+  memcpy(&word, m->text + (pc - m->text_addr), 4);
+  d = decode_insn(word);
+  kind = kind_of[d.op];
+
+  op->handler = handlers[kind];
+  op->rd = d.rd ? d.rd : 32;
+  op->rs1 = d.rs1;
+  op->rs2 = d.rs2;
+  op->imm = d.imm;
+
+  switch (d.op) {
+    case INSN_AUIPC:
+    case INSN_BEQ:
+    case INSN_BNE:
+    case INSN_JAL:
+      op->imm = pc + d.imm;
+      break;
+  }
+  return kind;
+}
+
+/*
+ * Decodes the block of @m that starts at @pc, which must be in text, and
+ * files it under @pc.
+ *
+ * Returns the block, or NULL if out of memory.
+ */
+static struct sim_block *translate(struct sim *m, uint32_t pc,
+                                   const void *const *handlers)
+{
+  struct sim_op ops[BLOCK_MAX + 1], *last;
+  struct sim_block *b;
+  uint32_t n = 0, a = pc, end = m->text_addr + m->text_size, nops = 0;
+  uint32_t dispatches = 0;
+  unsigned kind = K_NEXT, last_kind = K_NEXT;
+
+  while (a < end && n < BLOCK_MAX) {
+    last = nops ? &ops[nops - 1] : NULL;
+    kind = decode_op(m, a, &ops[nops], handlers);
+    ops[nops].at = n++;
+    a += 4;
+
+    /* la and li: the addi folds into the value of the lui or auipc, with
+     * the same wraparound as the two instructions */
+    if (m->fuse && last_kind == K_LUI && kind == K_ADDI
+        && ops[nops].rs1 == last->rd && ops[nops].rd == last->rd) {
+      last->imm = (int32_t)((uint32_t)last->imm + (uint32_t)ops[nops].imm);
+      continue;
+    }
+
+    /* Compare and branch: the compare runs straight into the branch */
+    if (m->fuse && (kind == K_BEQ || kind == K_BNE)) {
+      switch (last_kind) {
+        case K_ADDI:
+          last->handler = handlers[kind == K_BEQ ? K_ADDI_BEQ : K_ADDI_BNE];
+          dispatches--;
+          break;
+        case K_SLT:
+          last->handler = handlers[kind == K_BEQ ? K_SLT_BEQ : K_SLT_BNE];
+          dispatches--;
+          break;
+        case K_SLTI:
+          last->handler = handlers[kind == K_BEQ ? K_SLTI_BEQ : K_SLTI_BNE];
+          dispatches--;
+          break;
+      }
+    }
+
+    last_kind = kind;
+    nops++;
+    dispatches++;
+    if (kind >= K_BEQ && kind != K_ECALL) break;
+  }
+
+  /* Cut short: carry on at the word after */
+  if (kind < K_BEQ || kind == K_ECALL) {
+    ops[nops].handler = handlers[K_NEXT];
+    ops[nops].at = n;
+    ops[nops++].imm = a;
+    dispatches++;
+  }
+
+  b = arena_alloc(&m->blocks, sizeof(struct sim_block)
+                              + nops*sizeof(struct sim_op));
+  if (!b) return NULL;
+  b->pc = pc;
+  b->n = n;
+  b->dispatches = dispatches;
+  b->next[0] = b->next[1] = NULL;
+  memcpy(b->ops, ops, nops*sizeof(struct sim_op));
+  m->block_at[(pc - m->text_addr) / 4] = b;
+  return b;
+}
+
+/* Forgets every block, after a store into text; chains make it all or none */
+static void flush_blocks(struct sim *m)
+{
+  memset(m->block_at, 0, m->text_size / 4 * sizeof(struct sim_block *));
+  arena_reset(&m->blocks);
+}
+
+/* Returns the address of the 4 bytes at @addr, or NULL if not all mapped */
+static uint8_t *mem_at(struct sim *m, uint32_t addr)
+{
+  /* sim_init keeps data_size at least 4; text may be empty */
+  if (addr - m->data_addr <= m->data_size - 4) return m->data + (addr - m->data_addr);
+  if (m->text_size >= 4 && addr - m->text_addr <= m->text_size - 4) {
+    return m->text + (addr - m->text_addr);
+  }
+  return NULL;
+}
+
+/* Copies the NUL-terminated string at @addr to m->out */
+static void print_string(struct sim *m, uint32_t addr)
+{
+  uint32_t off = addr - m->data_addr;
+  const uint8_t *end;
+
+  if (off >= m->data_size) return;
+  end = memchr(m->data + off, 0, m->data_size - off);
+  fwrite(m->data + off, 1, end ? (size_t)(end - m->data - off)
+                                : m->data_size - off, m->out);
+}
+
+/*
+ * Carries out the ecall service in a7.
+ *
+ * Returns 1 if the program exits, 0 if it goes on, or -1 for an unknown
+ * service.
+ */
+static int ecall(struct sim *m)
+{
+  uint32_t a0 = m->x[10];
+
+  switch (m->x[17]) {
+    case 1:
+      fprintf(m->out, "%d", (int32_t)a0);
+      return 0;
+    case 4:
+      print_string(m, a0);
+      return 0;
+    case 11:
+      fputc(a0 & 0xff, m->out);
+      return 0;
+    case 10:
+      m->status = 0;
+      return 1;
+    case 93:
+      m->status = a0;
+      return 1;
+  }
+  return -1;
+}
+
+/* Records @why as the fault of the instruction at @pc */
+static enum sim_stop step_fault(struct sim *m, uint32_t pc, const char *why)
+{
+  m->fault = why;
+  m->fault_pc = pc;
+  return SIM_FAULT;
+}
+
+/* Public Interface */
+
+int sim_init(struct sim *m, const struct image *img, uint32_t data_size)
+{
+  uint32_t i;
+
+  memset(m, 0, sizeof(struct sim));
+  m->out = stdout;
+  arena_init(&m->blocks, BLOCK_ARENA_CHUNK);
+  m->fuse = 1;
+
+  if (img->data.size > data_size || data_size < 4) return -1;
+  m->data_addr = img->data.bytes ? img->data.addr : IMAGE_DATA_BEGIN;
+  m->data_size = data_size;
+
+  /* Text is whole words; a partial last one is padded with zeros */
+  m->text_addr = img->text.bytes ? img->text.addr : IMAGE_TEXT_BEGIN;
+  m->text_size = (img->text.size + 3) & ~3;
+
+  /* A segment that wraps past the top of memory would defeat every bounds
+   * check, which works on offsets from its start */
+  if (m->data_addr + data_size < m->data_addr ||
+      m->text_addr + m->text_size < m->text_addr) {
+    return -1;
+  }
+  m->data = calloc(data_size, 1);
+  m->text = calloc(m->text_size + 4, 1);
+  m->block_at = calloc(m->text_size / 4 + 1, sizeof(struct sim_block *));
+  if (!m->data || !m->text || !m->block_at) {
+    sim_free(m);
+    return -1;
+  }
+
+  if (img->data.size) memcpy(m->data, img->data.bytes, img->data.size);
+  if (img->text.size) memcpy(m->text, img->text.bytes, img->text.size);
+
+  /* .mxe images keep each data word reversed; memory is little-endian */
+  if (img->data_reversed) {
+    for (i = 0; i + 4 <= img->data.size; i += 4) {
+      uint32_t w;
+      memcpy(&w, m->data + i, 4);
+      w = __builtin_bswap32(w);
+      memcpy(m->data + i, &w, 4);
+    }
+  }
+
+  m->x[2] = m->data_addr + data_size;    /* sp */
+  m->x[3] = m->data_addr;                /* gp */
+  m->pc = img->has_entry ? img->entry : m->text_addr;
+  return 0;
+}
+enum sim_stop sim_run(struct sim *m)
+{
+  static const void *const handlers[NUM_KINDS] = {
+    [K_ADD] = &&do_add, [K_SUB] = &&do_sub, [K_SLL] = &&do_sll,
+    [K_SLT] = &&do_slt, [K_XOR] = &&do_xor, [K_SRL] = &&do_srl,
+    [K_SRA] = &&do_sra, [K_OR] = &&do_or, [K_AND] = &&do_and,
+    [K_ADDI] = &&do_addi, [K_SLTI] = &&do_slti, [K_XORI] = &&do_xori,
+    [K_ORI] = &&do_ori, [K_ANDI] = &&do_andi, [K_SLLI] = &&do_slli,
+    [K_SRLI] = &&do_srli, [K_SRAI] = &&do_srai,
+    [K_LUI] = &&do_lui,
+    [K_LW] = &&do_lw, [K_SW] = &&do_sw,
+    [K_BEQ] = &&do_beq, [K_BNE] = &&do_bne, [K_JAL] = &&do_jal,
+    [K_JALR] = &&do_jalr,
+    [K_ECALL] = &&do_ecall,
+    [K_ILLEGAL] = &&do_illegal,
+    [K_NEXT] = &&do_next,
+    [K_ADDI_BEQ] = &&do_addi_beq, [K_ADDI_BNE] = &&do_addi_bne,
+    [K_SLT_BEQ] = &&do_slt_beq, [K_SLT_BNE] = &&do_slt_bne,
+    [K_SLTI_BEQ] = &&do_slti_beq, [K_SLTI_BNE] = &&do_slti_bne,
+  };
+  uint32_t *x = m->x;
+  uint64_t steps = m->steps, dispatches = m->dispatches;
+  uint64_t max_steps = m->max_steps ? m->max_steps : UINT64_MAX;
+  struct sim_block *b = NULL, *nb;
+  struct sim_op *op = NULL;
+  uint32_t addr, target;
+  enum sim_stop stop;
+  int edge = -1;
+  uint8_t *p;
+
+/* The pc of the op being run */
+#define PC() (b->pc + 4*(uint32_t)op->at)
+
+/* Instructions of the block from op on; steps counted them on entry */
+#define UNRUN() (b->n - op->at)
+
+#define NEXT() do { op++; goto *op->handler; } while (0)
+
+/* Leaves the block by successor @i, whose first instruction is at @to */
+#define CHAIN(i, to) do {                                                     \
+    edge = (i);                                                               \
+    if ((nb = b->next[i])) goto enter;                                        \
+    target = (to);                                                            \
+    goto lookup;                                                              \
+  } while (0)
+
+#define FAULT_AT(pc, why) do {                                                \
+    m->fault = (why);                                                         \
+    m->fault_pc = (pc);                                                       \
+    goto fault;                                                               \
+  } while (0)
+
+/* Faults at op, which does not count as run */
+#define FAULT(why) do { steps -= UNRUN(); FAULT_AT(PC(), why); } while (0)
+
+  target = m->pc;
+  goto lookup;
+
+do_add:  x[op->rd] = x[op->rs1] + x[op->rs2]; NEXT();
+do_sub:  x[op->rd] = x[op->rs1] - x[op->rs2]; NEXT();
+do_sll:  x[op->rd] = x[op->rs1] << (x[op->rs2] & 31); NEXT();
+do_slt:  x[op->rd] = (int32_t)x[op->rs1] < (int32_t)x[op->rs2]; NEXT();
+do_xor:  x[op->rd] = x[op->rs1] ^ x[op->rs2]; NEXT();
+do_srl:  x[op->rd] = x[op->rs1] >> (x[op->rs2] & 31); NEXT();
+do_sra:  x[op->rd] = (int32_t)x[op->rs1] >> (x[op->rs2] & 31); NEXT();
+do_or:   x[op->rd] = x[op->rs1] | x[op->rs2]; NEXT();
+do_and:  x[op->rd] = x[op->rs1] & x[op->rs2]; NEXT();
+
+do_addi: x[op->rd] = x[op->rs1] + op->imm; NEXT();
+do_slti: x[op->rd] = (int32_t)x[op->rs1] < op->imm; NEXT();
+do_xori: x[op->rd] = x[op->rs1] ^ op->imm; NEXT();
+do_ori:  x[op->rd] = x[op->rs1] | op->imm; NEXT();
+do_andi: x[op->rd] = x[op->rs1] & op->imm; NEXT();
+do_slli: x[op->rd] = x[op->rs1] << op->imm; NEXT();
+do_srli: x[op->rd] = x[op->rs1] >> op->imm; NEXT();
+do_srai: x[op->rd] = (int32_t)x[op->rs1] >> op->imm; NEXT();
+
+do_lui:  x[op->rd] = op->imm; NEXT();
+
+do_lw:
+  addr = x[op->rs1] + op->imm;
+  if (addr - m->data_addr <= m->data_size - 4) {
+    memcpy(&x[op->rd], m->data + (addr - m->data_addr), 4);
+    NEXT();
+  }
+  if (!(p = mem_at(m, addr))) FAULT("load outside memory");
+  memcpy(&x[op->rd], p, 4);
+  NEXT();
+
+do_sw:
+  addr = x[op->rs1] + op->imm;
+  if (addr - m->data_addr <= m->data_size - 4) {
+    memcpy(m->data + (addr - m->data_addr), &x[op->rs2], 4);
+    NEXT();
+  }
+  if (!(p = mem_at(m, addr))) FAULT("store outside memory");
+  memcpy(p, &x[op->rs2], 4);
+  /* Code was overwritten, maybe this very block: decode again from here */
+  target = PC() + 4;
+  steps -= UNRUN() - 1;
+  flush_blocks(m);
+  b = NULL;
+  edge = -1;
+  goto lookup;
+
+do_beq:
+  if (x[op->rs1] == x[op->rs2]) CHAIN(0, op->imm);
+  CHAIN(1, PC() + 4);
+do_bne:
+  if (x[op->rs1] != x[op->rs2]) CHAIN(0, op->imm);
+  CHAIN(1, PC() + 4);
+
+do_addi_beq: x[op->rd] = x[op->rs1] + op->imm; op++; goto do_beq;
+do_addi_bne: x[op->rd] = x[op->rs1] + op->imm; op++; goto do_bne;
+do_slt_beq:  x[op->rd] = (int32_t)x[op->rs1] < (int32_t)x[op->rs2]; op++;
+             goto do_beq;
+do_slt_bne:  x[op->rd] = (int32_t)x[op->rs1] < (int32_t)x[op->rs2]; op++;
+             goto do_bne;
+do_slti_beq: x[op->rd] = (int32_t)x[op->rs1] < op->imm; op++; goto do_beq;
+do_slti_bne: x[op->rd] = (int32_t)x[op->rs1] < op->imm; op++; goto do_bne;
+
+do_jal:
+  x[op->rd] = PC() + 4;
+  CHAIN(0, op->imm);
+
+do_jalr:
+  /* Targets vary, so this edge is looked up every time */
+  target = (x[op->rs1] + op->imm) & ~1U;
+  x[op->rd] = PC() + 4;
+  edge = -1;
+  goto lookup;
+
+do_ecall:
+  switch (ecall(m)) {
+    case 0: NEXT();
+    case 1:
+      steps -= UNRUN() - 1;
+      m->pc = PC() + 4;
+      stop = SIM_EXIT;
+      goto out;
+  }
+  FAULT("unknown ecall service");
+
+do_illegal:
+  FAULT("illegal instruction");
+
+do_next:
+  if (!in_text(m, op->imm)) FAULT("ran past the end of .text");
+  CHAIN(1, op->imm);
+
+lookup:
+  /* Returning from main ends the program, as an exit would */
+  if (target == 0) {
+    m->status = x[10];
+    m->pc = 0;
+    stop = SIM_EXIT;
+    goto out;
+  }
+  if (!in_text(m, target)) {
+    if (!b) FAULT_AT(target, "jump outside .text");
+    FAULT("jump outside .text");
+  }
+  nb = m->block_at[(target - m->text_addr) / 4];
+  if (!nb && !(nb = translate(m, target, handlers))) {
+    FAULT_AT(target, "out of memory");
+  }
+  if (edge >= 0) b->next[edge] = nb;
+
+enter:
+  /* The limit is checked between blocks, so a run can pass it by a block */
+  if (steps >= max_steps) {
+    m->pc = nb->pc;
+    stop = SIM_LIMIT;
+    goto out;
+  }
+  b = nb;
+  steps += b->n;
+  dispatches += b->dispatches;
+  op = b->ops;
+  goto *op->handler;
+
+fault:
+  m->pc = m->fault_pc;
+  stop = SIM_FAULT;
+out:
+  m->steps = steps;
+  m->dispatches = dispatches;
+  return stop;
+
+#undef PC
+#undef UNRUN
+#undef NEXT
+#undef CHAIN
+#undef FAULT_AT
+#undef FAULT
+}
+
+enum sim_stop sim_step(struct sim *m, struct sim_trace *t)
+{
+  uint32_t *x = m->x, pc = m->pc, next = pc + 4, addr = 0, word, v;
+  struct decoded_insn d;
+  uint8_t *p;
+
+  if (m->max_steps && m->steps >= m->max_steps) return SIM_LIMIT;
+  if (!in_text(m, pc)) return step_fault(m, pc, "jump outside .text");
+
+  memcpy(&word, m->text + (pc - m->text_addr), 4);
+  d = decode_insn(word);
+
+  switch (d.op) {
+    case INSN_ADD:   v = x[d.rs1] + x[d.rs2]; break;
+    case INSN_SUB:   v = x[d.rs1] - x[d.rs2]; break;
+    case INSN_SLL:   v = x[d.rs1] << (x[d.rs2] & 31); break;
+    case INSN_SLT:   v = (int32_t)x[d.rs1] < (int32_t)x[d.rs2]; break;
+    case INSN_XOR:   v = x[d.rs1] ^ x[d.rs2]; break;
+    case INSN_SRL:   v = x[d.rs1] >> (x[d.rs2] & 31); break;
+    case INSN_SRA:   v = (int32_t)x[d.rs1] >> (x[d.rs2] & 31); break;
+    case INSN_OR:    v = x[d.rs1] | x[d.rs2]; break;
+    case INSN_AND:   v = x[d.rs1] & x[d.rs2]; break;
+    case INSN_ADDI:  v = x[d.rs1] + d.imm; break;
+    case INSN_SLTI:  v = (int32_t)x[d.rs1] < d.imm; break;
+    case INSN_XORI:  v = x[d.rs1] ^ d.imm; break;
+    case INSN_ORI:   v = x[d.rs1] | d.imm; break;
+    case INSN_ANDI:  v = x[d.rs1] & d.imm; break;
+    case INSN_SLLI:  v = x[d.rs1] << d.imm; break;
+    case INSN_SRLI:  v = x[d.rs1] >> d.imm; break;
+    case INSN_SRAI:  v = (int32_t)x[d.rs1] >> d.imm; break;
+    case INSN_LUI:   v = d.imm; break;
+    case INSN_AUIPC: v = pc + d.imm; break;
+    case INSN_LW:
+      addr = x[d.rs1] + d.imm;
+      if (!(p = mem_at(m, addr))) {
+        return step_fault(m, pc, "load outside memory");
+      }
+      memcpy(&v, p, 4);
+      break;
+    case INSN_SW:
+      addr = x[d.rs1] + d.imm;
+      if (!(p = mem_at(m, addr))) {
+        return step_fault(m, pc, "store outside memory");
+      }
+      memcpy(p, &x[d.rs2], 4);
+      /* Code was overwritten: have sim_run decode it again */
+      if (addr - m->text_addr < m->text_size) flush_blocks(m);
+      v = 0;
+      break;
+    case INSN_BEQ:
+    case INSN_BNE:
+      if ((x[d.rs1] == x[d.rs2]) == (d.op == INSN_BEQ)) next = pc + d.imm;
+      v = 0;
+      break;
+    case INSN_JAL:
+      next = pc + d.imm;
+      v = pc + 4;
+      break;
+    case INSN_JALR:
+      next = (x[d.rs1] + d.imm) & ~1U;
+      v = pc + 4;
+      break;
+    case INSN_ECALL:
+      switch (ecall(m)) {
+        case -1:
+          return step_fault(m, pc, "unknown ecall service");
+        case 1:
+          next = 0;
+          break;
+      }
+      v = 0;
+      break;
+    default:
+      return step_fault(m, pc, "illegal instruction");
+  }
+
+  /* Returning from main ends the program, as an exit would */
+  if (next == 0 && d.op != INSN_ECALL) m->status = x[10];
+  else if (next && !in_text(m, next)) {
+    return step_fault(m, pc, "jump outside .text");
+  }
+
+  x[d.rd ? d.rd : 32] = v;
+  m->steps++;
+  m->pc = next;
+  t->pc = pc;
+  t->next_pc = next;
+  t->addr = addr;
+  t->insn = d;
+  return next ? SIM_RUNNING : SIM_EXIT;
+}
+
+void sim_free(struct sim *m)
+{
+  free(m->data);
+  free(m->text);
+  free(m->block_at);
+  arena_free(&m->blocks);
+  memset(m, 0, sizeof(struct sim));
+}
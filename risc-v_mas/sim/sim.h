@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include "arena.h"
+#include "decode.h"
+#include "image.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Default bytes of data memory, from IMAGE_DATA_BEGIN; the stack is on top */
+#define SIM_DATA_SIZE (16*1024*1024)
+
+/* Why a run stopped */
+enum sim_stop {
+  SIM_EXIT,         /* ecall exit, or main returned */
+  SIM_FAULT,        /* See fault and fault_pc */
+  SIM_LIMIT,        /* Ran max_steps instructions */
+  SIM_RUNNING       /* sim_step only: one instruction ran, more follow */
+};
+
+/* One instruction as sim_step ran it */
+struct sim_trace {
+  uint32_t pc;
+  uint32_t next_pc;         /* Where control went: pc + 4 unless it jumped */
+  uint32_t addr;            /* The address lw or sw accessed */
+  struct decoded_insn insn;
+};
+
+struct sim_block;
+
+/* A machine running one program */
+struct sim {
+  uint32_t x[33];           /* Registers; x[32] takes the writes to x0 */
+  uint32_t pc;
+  uint8_t *data;            /* Data memory, little-endian */
+  uint32_t data_addr;
+  uint32_t data_size;
+  uint8_t *text;            /* Text memory, little-endian */
+  uint32_t text_addr;
+  uint32_t text_size;
+  struct sim_block **block_at; /* Decoded block starting at each text word */
+  struct arena blocks;      /* Where the blocks live */
+  int fuse;                 /* Fuse common pairs into superinstructions */
+  uint64_t steps;           /* Instructions run */
+  uint64_t dispatches;      /* Ops sim_run dispatched, counted per block */
+  uint64_t max_steps;       /* Stop after about this many, 0 for no limit */
+  int status;               /* Exit status, for SIM_EXIT */
+  const char *fault;        /* What went wrong, for SIM_FAULT */
+  uint32_t fault_pc;        /* Address of the faulting instruction */
+  FILE *out;                /* Where ecalls print */
+};
+
+/**
+ * Loads the program of @img into @m, with @data_size bytes of data memory.
+ * Registers start at 0, except sp, which points to the top of data memory,
+ * and gp, which points to its start. The pc is the entry point of @img, or the
+ * start of text.
+ *
+ * Returns 0 on success, or -1 if the image does not fit, a segment would wrap
+ * past the top of the address space or memory ran out.
+ */
+int sim_init(struct sim *m, const struct image *img, uint32_t data_size);
+
+/**
+ * Runs @m until the program exits, faults or runs m->max_steps instructions.
+ * The run can be resumed after SIM_LIMIT.
+ *
+ * ecall takes the service number in a7 and its argument in a0: 1 prints the
+ * integer, 4 prints the string, 11 prints the character, 10 exits with status
+ * 0 and 93 exits with status a0. Returning from main, to address 0, exits with
+ * status a0.
+ *
+ * Returns why the run stopped.
+ */
+enum sim_stop sim_run(struct sim *m);
+
+/**
+ * Runs the one instruction of @m at m->pc, decoding it afresh, and describes
+ * it in @t. This is the slow path, for models that need to see every
+ * instruction; it does the same as sim_run and the two can be mixed.
+ *
+ * Returns SIM_RUNNING, or SIM_EXIT if the instruction ended the program; @t
+ * is filled in for both. Returns SIM_FAULT or SIM_LIMIT, with @t untouched,
+ * if the instruction could not run.
+ */
+enum sim_stop sim_step(struct sim *m, struct sim_trace *t);
+
+/**
+ * Frees the memory of @m.
+ */
+void sim_free(struct sim *m);
+
+#endif /* SIM_H_ */
@@ -26,60 +26,221 @@
  */
 
 #include "symtab.h"
+#include "arena.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define TBLSZ (255)
+/* The table doubles once it is 3/4 full, so probe sequences stay short */
+#define MIN_TBLSZ (256)
+#define MAX_LOAD(sz) ((sz) - (sz)/4)
+
 struct symbol {
-  char *label;
+  const char *label;  /* interned name, NULL for an empty slot */
+  uint32_t len;       /* length of the name */
+  uint32_t hash;      /* full hash of the name */
   uint32_t address;
+  uint32_t pending;   /* references waiting for the definition */
+  int defined;        /* 0 if only referenced so far */
+  int exported;       /* visible to other source files */
 };
-static struct symbol symtab[TBLSZ] = {0};
 
 
 /* djb2 hash function (public domain) */
-static uint32_t hash(char *str) {
+static uint32_t hash(const char *str, uint32_t len) {
   uint32_t hash = 5381;
-  int c;
-  while (c = *str++) hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+  while (len--) hash = ((hash << 5) + hash) + (unsigned char)*str++; /* hash * 33 + c */
   return hash;
 }
 
-void symtab_add(char *lbl, uint32_t addr)
+/* Returns the slot holding @lbl, or the empty slot where it belongs */
+static struct symbol *probe(struct symbol *tbl, uint32_t sz, const char *lbl,
+                            uint32_t len, uint32_t hv)
 {
-  uint32_t hv = hash(lbl) % TBLSZ;
+  uint32_t i = hv & (sz - 1);
 
-  while (symtab[hv].label) {
-    if (strncmp(symtab[hv].label, lbl, strlen(lbl)) == 0) {
-      return; /* matching symbol found */
+  while (tbl[i].label) {
+    if (tbl[i].hash == hv && tbl[i].len == len &&
+        memcmp(tbl[i].label, lbl, len) == 0) {
+      break; /* matching symbol found */
     }
-    hv = (hv + 1) % TBLSZ;
+    i = (i + 1) & (sz - 1);
   }
-  symtab[hv].label = lbl;
-  symtab[hv].address = addr;
+  return &tbl[i];
 }
 
-uint32_t symtab_find_address(char *lbl)
+/* Moves every symbol into a table of @sz slots, using the cached hashes */
+static int resize(struct symtab *st, uint32_t sz)
 {
-  uint32_t hv = hash(lbl) % TBLSZ;
-  while (symtab[hv].label) {
-    if (strncmp(symtab[hv].label, lbl, strlen(lbl)) == 0) {
-      return symtab[hv].address; /* matching symbol found */
+  struct symbol *tbl = calloc(sz, sizeof(struct symbol));
+  struct symbol *sym;
+
+  if (!tbl) return -1;
+
+  for (sym = st->syms; sym < st->syms + st->tblsz; sym++) {
+    if (sym->label) {
+      *probe(tbl, sz, sym->label, sym->len, sym->hash) = *sym;
     }
-    hv = (hv + 1) % TBLSZ;
   }
+
+  free(st->syms);
+  st->syms = tbl;
+  st->tblsz = sz;
+  return 0;
+}
+
+/* Returns the slot of @lbl, inserting it as undefined if it is new */
+static struct symbol *lookup_or_insert(struct symtab *st, const char *lbl)
+{
+  uint32_t len = strlen(lbl);
+  uint32_t hv = hash(lbl, len);
+  struct symbol *sym;
+  char *name;
+
+  if (st->nsyms + 1 > MAX_LOAD(st->tblsz)) {
+    if (resize(st, st->tblsz ? 2*st->tblsz : MIN_TBLSZ) != 0) return NULL;
+  }
+
+  sym = probe(st->syms, st->tblsz, lbl, len, hv);
+  if (sym->label) return sym;
+
+  name = arena_alloc(&st->names, len + 1);
+  if (!name) return NULL;
+  memcpy(name, lbl, len + 1);
+
+  sym->label = name;
+  sym->len = len;
+  sym->hash = hv;
+  sym->address = 0;
+  sym->pending = 0;
+  sym->defined = 0;
+  sym->exported = 0;
+  st->nsyms++;
+  return sym;
+}
+
+void symtab_init(struct symtab *st)
+{
+  st->syms = NULL;
+  st->tblsz = 0;
+  st->nsyms = 0;
+  arena_init(&st->names, 0);
+}
+
+int symtab_add(struct symtab *st, const char *lbl, uint32_t addr,
+               uint32_t *pending)
+{
+  struct symbol *sym = lookup_or_insert(st, lbl);
+
+  *pending = 0;
+  if (!sym || sym->defined) return -1;
+
+  sym->address = addr;
+  sym->defined = 1;
+  *pending = sym->pending;
+  sym->pending = 0;
+  return 0;
+}
+
+uint32_t *symtab_pending(struct symtab *st, const char *lbl,
+                         const char **name)
+{
+  struct symbol *sym = lookup_or_insert(st, lbl);
+
+  if (!sym || sym->defined) return NULL;
+
+  *name = sym->label;
+  return &sym->pending;
+}
+
+int symtab_export(struct symtab *st, const char *lbl)
+{
+  struct symbol *sym = lookup_or_insert(st, lbl);
+
+  if (!sym) return -1;
+  sym->exported = 1;
   return 0;
 }
 
-void symtab_print()
+int symtab_find(const struct symtab *st, const char *lbl, uint32_t *addr)
+{
+  uint32_t len = strlen(lbl);
+  struct symbol *sym;
+
+  if (st->nsyms == 0) return 0;
+
+  sym = probe(st->syms, st->tblsz, lbl, len, hash(lbl, len));
+  if (!sym->defined) return 0;
+
+  *addr = sym->address;
+  return 1;
+}
+
+void symtab_relocate(struct symtab *st, uint32_t lo, uint32_t hi,
+                     int32_t delta)
+{
+  struct symbol *sym;
+
+  for (sym = st->syms; sym < st->syms + st->tblsz; sym++) {
+    if (sym->defined && sym->address >= lo && sym->address < hi) {
+      sym->address += delta;
+    }
+  }
+}
+
+int symtab_merge_exports(struct symtab *dst, const struct symtab *src,
+                         struct diag *diag)
+{
+  const struct symbol *sym;
+  uint32_t pending;
+  int errors = 0;
+
+  for (sym = src->syms; sym < src->syms + src->tblsz; sym++) {
+    if (!sym->exported) continue;
+
+    if (!sym->defined) {
+      diag_error(diag, "Undefined global symbol: %s", sym->label);
+      errors++;
+    } else if (symtab_add(dst, sym->label, sym->address, &pending) != 0) {
+      diag_error(diag, "Duplicate global symbol: %s", sym->label);
+      errors++;
+    }
+  }
+  return errors;
+}
+
+void symtab_foreach(const struct symtab *st,
+                    void (*fn)(void *arg, const char *lbl, uint32_t addr),
+                    void *arg)
+{
+  const struct symbol *sym;
+
+  for (sym = st->syms; sym < st->syms + st->tblsz; sym++) {
+    if (sym->defined) fn(arg, sym->label, sym->address);
+  }
+}
+
+void symtab_print(const struct symtab *st)
 {
   int i;
-  for (i = 0; i < TBLSZ; i++) {
-    if (symtab[i].label) {
-      printf("%d\t%s\t%x\n", i, symtab[i].label, symtab[i].address);
+  for (i = 0; i < st->tblsz; i++) {
+    if (st->syms[i].defined) {
+      printf("%d\t%s\t%x\n", i, st->syms[i].label, st->syms[i].address);
     }
   }
 }
 
+void symtab_clear(struct symtab *st)
+{
+  if (st->tblsz) memset(st->syms, 0, st->tblsz * sizeof(struct symbol));
+  st->nsyms = 0;
+  arena_reset(&st->names);
+}
+
+void symtab_free(struct symtab *st)
+{
+  arena_free(&st->names);
+  free(st->syms);
+  symtab_init(st);
+}
@@ -28,11 +28,102 @@
 #ifndef SYMTAB_H_
 #define SYMTAB_H_
 
+#include "arena.h"
+#include "diag.h"
+
 #include <stdint.h>
 
-void symtab_add(char *lbl, uint32_t addr);
-uint32_t symtab_find_address(char *lbl);
-void symtab_print(void);
+struct symbol;
+
+/* A table of labels. Tables are independent, so each thread can own one. */
+struct symtab {
+  struct symbol *syms;  /* Open-addressed slots */
+  uint32_t tblsz;       /* Number of slots, always a power of two */
+  uint32_t nsyms;       /* Number of used slots */
+  struct arena names;   /* Holds the interned names */
+};
+
+/**
+ * Initializes @st as an empty table.
+ */
+void symtab_init(struct symtab *st);
+
+/**
+ * Defines the label @lbl at @addr. The table keeps its own copy of the name.
+ *
+ * If @lbl was referenced before being defined, the head of its pending list
+ * (see symtab_pending) is stored in @pending, which is otherwise set to 0.
+ *
+ * Returns 0 on success, or -1 if @lbl is already defined (the first definition
+ * is kept) or memory ran out.
+ */
+int symtab_add(struct symtab *st, const char *lbl, uint32_t addr,
+               uint32_t *pending);
+
+/**
+ * Records a reference to the label @lbl, which is not defined yet.
+ *
+ * Returns the head of the list of references that wait for @lbl to be
+ * defined. The table only stores the head; its meaning is up to the caller,
+ * who links new references in front of it. The interned name of @lbl is
+ * stored in @name. The pointer is valid until the next symtab call.
+ *
+ * Returns NULL if @lbl is already defined or memory ran out.
+ */
+uint32_t *symtab_pending(struct symtab *st, const char *lbl,
+                         const char **name);
+
+/**
+ * Marks the label @lbl as exported, whether or not it is defined yet.
+ *
+ * Returns 0 on success, or -1 if memory ran out.
+ */
+int symtab_export(struct symtab *st, const char *lbl);
+
+/**
+ * Looks up the label @lbl and stores its address in @addr.
+ *
+ * Returns 1 if @lbl is defined, 0 if it is not.
+ */
+int symtab_find(const struct symtab *st, const char *lbl, uint32_t *addr);
+
+/**
+ * Adds @delta to the address of every label defined in [@lo, @hi).
+ */
+void symtab_relocate(struct symtab *st, uint32_t lo, uint32_t hi,
+                     int32_t delta);
+
+/**
+ * Defines in @dst every label exported by @src, which must all be defined.
+ *
+ * Returns the number of exported labels that were undefined in @src or
+ * already defined in @dst, after reporting each of them to @diag.
+ */
+int symtab_merge_exports(struct symtab *dst, const struct symtab *src,
+                         struct diag *diag);
+
+/**
+ * Calls @fn with @arg, the name and the address of every defined label of
+ * @st, in no particular order.
+ */
+void symtab_foreach(const struct symtab *st,
+                    void (*fn)(void *arg, const char *lbl, uint32_t addr),
+                    void *arg);
+
+/**
+ * Prints the symbols to stdout, for debugging.
+ */
+void symtab_print(const struct symtab *st);
+
+/**
+ * Removes all symbols, keeping the memory of the table for reuse.
+ */
+void symtab_clear(struct symtab *st);
+
+/**
+ * Removes all symbols and frees the table.
+ */
+void symtab_free(struct symtab *st);
 
 #endif /* SYMTAB_H_ */
 
@@ -0,0 +1,10 @@
+cycles        139
+instructions  93
+CPI           1.495
+stalls        load-use 0, data 0, branch 0
+flushes       branch 9, jal 12, jalr 13 (44 instructions squashed)
+branches      13, 9 taken
+predictor     gshare, 1024 entries, 10 history bits, 4 return stack entries
+branch hits   4 of 13 (30.77%)
+return hits   12 of 13 (92.31%)
+mispredicts   10, costing 20 cycles (2.00 each)
@@ -0,0 +1,10 @@
+cycles        151
+instructions  93
+CPI           1.624
+stalls        load-use 0, data 0, branch 0
+flushes       branch 9, jal 12, jalr 13 (56 instructions squashed)
+branches      13, 9 taken
+predictor     nt, 0 return stack entries
+branch hits   4 of 13 (30.77%)
+return hits   0 of 0 (0.00%)
+mispredicts   9, costing 18 cycles (2.00 each)
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2021 Regents of University of Colorado
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks libmas the way an embedding program uses it: several sources in turn
+ * on one context, errors counted and not printed, and contexts on separate
+ * threads. Prints each failed check and exits nonzero if there was one.
+ */
+
+#include "mas.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SEGMENT_CAP (4096)
+#define NTHREADS (4)
+#define NROUNDS (200)
+
+/* Load addresses of the segments, as in an .mxe image */
+#define DATA_ADDR (0x10000000)
+#define TEXT_ADDR (0x00400000)
+
+static const char first[] =
+  ".data\n"
+  "x:\t.word 5\n"
+  ".text\n"
+  "main:\n"
+  "\tlw a0, 0(gp)\n"
+  "\tjal zero, done\n"
+  "done:\n"
+  "\tret\n";
+
+static const char second[] =
+  ".text\n"
+  "start:\n"
+  "\tnop\n"
+  "end:\n"
+  "\tret\n";
+
+/* An instruction short of an operand and a jump to nowhere */
+static const char bad[] =
+  ".text\n"
+  "\tadd a0, a1\n"
+  "\tjal zero, nowhere\n"
+  "\tret\n";
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      __atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED); \
+    } \
+  } while (0)
+
+/* Keeps the messages of the bad source off stderr */
+static void quiet(void *arg, const char *msg)
+{
+  (void)arg;
+  (void)msg;
+}
+
+/* Returns the address of @lbl in @ctx, or 1, which no label can have */
+static uint32_t symbol(const struct mas_context *ctx, const char *lbl)
+{
+  uint32_t addr;
+
+  return mas_symbol(ctx, lbl, &addr) ? addr : 1;
+}
+
+/* Assembles first, second and bad in turn on one context */
+static void check_in_turn(void)
+{
+  static uint8_t data[SEGMENT_CAP], text[SEGMENT_CAP];
+  struct mas_context ctx;
+  uint32_t word;
+
+  mas_init(&ctx, data, sizeof(data), text, sizeof(text));
+  ctx.diag.report = quiet;
+
+  CHECK(mas_assemble(&ctx, first, strlen(first)) == 0);
+  CHECK(symbol(&ctx, "x") == DATA_ADDR);
+  CHECK(symbol(&ctx, "main") == TEXT_ADDR);
+  CHECK(symbol(&ctx, "done") == TEXT_ADDR + 8);
+  CHECK(ctx.data_size == 4 && ctx.text_size == 12);
+  memcpy(&word, text + 4, 4);
+  CHECK(word == 0x0040006f);            /* jal zero, done */
+
+  /* Nothing of the first source is left over */
+  CHECK(mas_assemble(&ctx, second, strlen(second)) == 0);
+  CHECK(symbol(&ctx, "start") == TEXT_ADDR);
+  CHECK(symbol(&ctx, "end") == TEXT_ADDR + 4);
+  CHECK(symbol(&ctx, "main") == 1);
+  CHECK(ctx.data_size == 0 && ctx.text_size == 8);
+  memcpy(&word, text + 8, 4);
+  CHECK(word == 0);
+
+  /* The same again, a line at a time */
+  ctx.opts.one_pass = 1;
+  CHECK(mas_assemble(&ctx, first, strlen(first)) == 0);
+  CHECK(symbol(&ctx, "done") == TEXT_ADDR + 8);
+  memcpy(&word, text + 4, 4);
+  CHECK(word == 0x0040006f);
+  ctx.opts.one_pass = 0;
+
+  CHECK(mas_assemble(&ctx, bad, strlen(bad)) == 2);
+  CHECK(ctx.diag.nerrors == 2);
+  CHECK(symbol(&ctx, "end") == 1);
+
+  /* and the context still works after errors */
+  CHECK(mas_assemble(&ctx, second, strlen(second)) == 0);
+  CHECK(ctx.diag.nerrors == 0);
+  CHECK(symbol(&ctx, "end") == TEXT_ADDR + 4);
+
+  mas_free(&ctx);
+}
+
+/* Assembles the sources over and over on a context of its own */
+static void *assemble_rounds(void *arg)
+{
+  uint8_t data[SEGMENT_CAP], text[SEGMENT_CAP];
+  struct mas_context ctx;
+  int i;
+
+  (void)arg;
+  mas_init(&ctx, data, sizeof(data), text, sizeof(text));
+  ctx.diag.report = quiet;
+  for (i = 0; i < NROUNDS; i++) {
+    CHECK(mas_assemble(&ctx, first, strlen(first)) == 0);
+    CHECK(symbol(&ctx, "done") == TEXT_ADDR + 8);
+    CHECK(mas_assemble(&ctx, bad, strlen(bad)) == 2);
+    CHECK(mas_assemble(&ctx, second, strlen(second)) == 0);
+    CHECK(symbol(&ctx, "end") == TEXT_ADDR + 4);
+  }
+  mas_free(&ctx);
+  return NULL;
+}
+
+static void check_threads(void)
+{
+  pthread_t threads[NTHREADS];
+  int i, started = 0;
+
+  for (i = 0; i < NTHREADS; i++) {
+    if (pthread_create(&threads[started], NULL, assemble_rounds, NULL) != 0) {
+      break;
+    }
+    started++;
+  }
+  CHECK(started == NTHREADS);
+  for (i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+int main(void)
+{
+  check_in_turn();
+  check_threads();
+  if (failures) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("libmas: all checks passed\n");
+  return 0;
+}
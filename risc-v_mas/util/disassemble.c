@@ -30,451 +30,446 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "decode.h"
+#include "image.h"
+#include "regs.h"
 
 #define DEBUG
 
-#define DATA_BEGIN (0x10000000)
-#define TEXT_BEGIN (0x00400000)
+/* Room put_insn needs, for the longest such as "srai zero, zero, -2048" */
+#define DECODE_MAX (32)
 
-static char *get_reg_name(uint8_t reg_idx)
-{
-  char *regnames[] = {
-    "zero",
-    "ra",
-    "sp",
-    "gp",
-    "tp",
-    "t0",
-    "t1",
-    "t2",
-    "s0",
-    "s1",
-    "a0",
-    "a1",
-    "a2",
-    "a3",
-    "a4",
-    "a5",
-    "a6",
-    "a7",
-    "s2",
-    "s3",
-    "s4",
-    "s5",
-    "s6",
-    "s7",
-    "s8",
-    "s9",
-    "s10",
-    "s11",
-    "t3",
-    "t4",
-    "t5",
-    "t6"
-  };
-
-  assert(reg_idx < 32);
-  return regnames[reg_idx];
-}
+/* Longest output line: address, bytes, the instruction and a newline */
+#define OUT_LINE_MAX (10 + 12 + DECODE_MAX + 1)
 
+/* Words that one thread formats at a time */
+#define CHUNK_WORDS (16*1024)
 
-static char *decode_operation(uint8_t opcode, uint8_t funct3, uint8_t funct7)
-{
-  switch (opcode) {
-    case 0x3:
-      if (funct3 == 0x2) return "lw";
-      break;
-
-    case 0x13: /* immediates */
-      switch (funct3) {
-        case 0x0:
-          return "addi";
-        case 0x1:
-          if (funct7 == 0) return "slli";
-          break;
-        case 0x2:
-          return "slti";
-        case 0x4:
-          return "xori";
-        case 0x5:
-          if (funct7 == 0) return "srli";
-          if (funct7 == 0x20) return "srai";
-          break;
-        case 0x6:
-          return "ori";
-        case 0x7:
-          return "andi";
-      }
-      break;
-
-    case 0x17:
-      return "auipc";
-      break;
-
-    case 0x23:
-      if (funct3 == 0x2) return "sw";
-      break;
-
-    case 0x33:
-      switch (funct3) {
-        case 0x0:
-          if (funct7 == 0) return "add";
-          else if (funct7 == 0x20) return "sub";
-          break;
-        case 0x1:
-          if (funct7 == 0) return "sll";
-          break;
-        case 0x2:
-          if (funct7 == 0) return "slt";
-          break;
-        case 0x4:
-          if (funct7 == 0) return "xor";
-          break;
-        case 0x5:
-          if (funct7 == 0) return "srl";
-          else if (funct7 == 0x20) return "sra";
-          break;
-        case 0x6:
-          if (funct7 == 0) return "or";
-          break;
-        case 0x7:
-          if (funct7 == 0) return "and";
-          break;
-      }
-      break;
-
-    case 0x37:
-      return "lui";
-      break;
-
-    case 0x63:
-      switch (funct3) {
-        case 0x0:
-          return "beq";
-        case 0x1:
-          return "bne";
-      }
-      break;
-
-    case 0x67:
-      if (funct3 == 0) return "jalr";
-      break;
-      
-    case 0x6F:
-      return "jal";
-      break;
-
-    case 0x73:
-      if (funct3 == 0 && funct7 == 0) return "ecall";
-      break;
-
-    default:
-      break;
-  }
+/* Most threads that -j asks for */
+#define MAX_THREADS (64)
 
-  return "unknown";
-}
+/*
+ * The operand formatters append to the buffer at @s and return the end of
+ * what they wrote. None of them writes a NUL.
+ */
 
-static uint8_t get_rs1(uint32_t iw)
+static char *put_str(char *s, const char *str)
 {
-  return (iw >> 15) & 0x1f;
+  while (*str) *s++ = *str++;
+  return s;
 }
 
-static uint8_t get_rs2(uint32_t iw)
+static char *put_int(char *s, int32_t n)
 {
-  return (iw >> 20) & 0x1f;
+  char digits[10];
+  uint32_t u = n < 0 ? -(uint32_t)n : (uint32_t)n;
+  int i = 0;
+
+  if (n < 0) *s++ = '-';
+  do {
+    digits[i++] = '0' + u % 10;
+    u /= 10;
+  } while (u);
+  while (i) *s++ = digits[--i];
+  return s;
 }
 
-static uint8_t get_rd(uint32_t iw)
+/* Writes the low @ndigits hex digits of @n, in upper case if @upper */
+static char *put_hex(char *s, uint32_t n, int ndigits, int upper)
 {
-  return (iw >> 7) & 0x1f;
+  const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+
+  while (ndigits--) *s++ = digits[(n >> 4*ndigits) & 0xf];
+  return s;
 }
 
-static int16_t get_imm(uint32_t iw)
+/* Writes @n in hex, without leading zeros */
+static char *put_hex_trimmed(char *s, uint32_t n)
 {
-  return ((int32_t)iw >> 20);
+  int ndigits = 1;
+
+  while (ndigits < 8 && n >> 4*ndigits) ndigits++;
+  return put_hex(s, n, ndigits, 0);
 }
 
-static char *get_lw_operands(uint32_t iw)
+static char *put_reg(char *s, uint8_t reg)
 {
-  char *s = malloc(4+2+5+6+1);
-  uint8_t rs1, rd;
-  rs1 = get_rs1(iw);
-  rd = get_rd(iw);
+  return put_str(s, reg_name(reg));
+}
 
-  snprintf(s, 4+2+5+6+1, "%s, %d(%s)",
-      get_reg_name(rd), get_imm(iw), get_reg_name(rs1));
+static char *put_sep(char *s)
+{
+  *s++ = ',';
+  *s++ = ' ';
   return s;
 }
 
-static char *get_i_fmt_operands(uint32_t iw)
+/* "reg, imm(base)" */
+static char *put_mem_operands(char *s, uint8_t reg, int32_t imm, uint8_t base)
 {
-  char *s = malloc(4+2+4+2+5+1);
-  uint8_t rs1, rd;
-  rs1 = get_rs1(iw);
-  rd = get_rd(iw);
-
-  snprintf(s, 4+2+4+2+5+1, "%s, %s, %d",
-      get_reg_name(rd), get_reg_name(rs1), get_imm(iw));
+  s = put_sep(put_reg(s, reg));
+  s = put_int(s, imm);
+  *s++ = '(';
+  s = put_reg(s, base);
+  *s++ = ')';
   return s;
 }
 
-static char *get_s_fmt_operands(uint32_t iw)
+/* Formats the operands of @d in the syntax that mas accepts */
+static char *put_operands(char *s, const struct decoded_insn *d)
 {
-  char *s = malloc(4+2+5+6+1);
-  uint8_t rs1, rs2;
-  uint16_t imm;
-  rs1 = get_rs1(iw);
-  rs2 = get_rs2(iw);
+  switch (d->format) {
+    case FMT_R:
+      s = put_sep(put_reg(s, d->rd));
+      s = put_sep(put_reg(s, d->rs1));
+      return put_reg(s, d->rs2);
+
+    case FMT_I:
+      if (d->op == INSN_ECALL) return s;
+      if (d->op == INSN_LW || d->op == INSN_JALR) {
+        return put_mem_operands(s, d->rd, d->imm, d->rs1);
+      }
+      s = put_sep(put_reg(s, d->rd));
+      s = put_sep(put_reg(s, d->rs1));
+      return put_int(s, d->imm);
 
-  imm = (((int32_t)iw >> 20) & ~(0x1f)) | ((iw >> 7) & 0x1f);
+    case FMT_S:
+      return put_mem_operands(s, d->rs2, d->imm, d->rs1);
 
-  snprintf(s, 4+2+5+6+1, "%s, %d(%s)",
-      get_reg_name(rs2), imm, get_reg_name(rs1));
+    case FMT_SB:
+      s = put_sep(put_reg(s, d->rs1));
+      s = put_sep(put_reg(s, d->rs2));
+      return put_int(s, d->imm);
+
+    case FMT_U:
+      s = put_sep(put_reg(s, d->rd));
+      return put_int(s, d->imm >> 12);
+
+    case FMT_UJ:
+      s = put_sep(put_reg(s, d->rd));
+      return put_int(s, d->imm);
+  }
   return s;
 }
 
-static char *get_r_fmt_operands(uint32_t iw)
+/* "mnemonic operands" */
+static char *put_insn(char *s, const struct decoded_insn *d)
 {
-  char *s = malloc(4+2+4+2+4+2+1);
-  uint8_t rs1, rs2, rd;
-  rs1 = get_rs1(iw);
-  rs2 = get_rs2(iw);
-  rd = get_rd(iw);
-
-  snprintf(s, 4+2+4+2+4+2+1, "%s, %s, %s",
-      get_reg_name(rd), get_reg_name(rs1), get_reg_name(rs2));
+  s = put_str(s, insn_name(d->op));
+  if (d->op != INSN_UNKNOWN && d->op != INSN_ECALL) {
+    *s++ = ' ';
+    s = put_operands(s, d);
+  }
   return s;
 }
 
-static char *get_u_fmt_operands(uint32_t iw)
+/* The image being printed, which the formatting threads only read */
+static const struct image *image;
+
+/* A run of words that one thread formats into its own buffer */
+struct chunk {
+  uint32_t addr;            /* Address of the first word */
+  uint32_t seg_addr;        /* Address of the segment the words are in */
+  const uint32_t *words;    /* words[-1] is valid past the segment start */
+  size_t nwords;            /* At most CHUNK_WORDS */
+  char *buf;                /* Room for CHUNK_WORDS lines of line_max() */
+  size_t len;               /* Bytes of output in buf */
+};
+
+struct pool {
+  struct chunk *chunks;
+  int nchunks;
+  int next;                 /* Index of the next chunk to take */
+};
+
+/* Threads that format a segment, set by -j */
+static int nthreads = 1;
+
+/* Returns the room one line can take, with its label and annotation */
+static size_t line_max(void)
 {
-  char *s = malloc(4+2+8+1);
-  uint8_t rd;
-  uint32_t long_imm;
-  rd = get_rd(iw);
-
-  long_imm = (int32_t)iw >> 12;
-
-  snprintf(s, 4+2+8+1, "%s, %d",
-      get_reg_name(rd), long_imm);
-  return s;
-
+  /* "\n%.8X <%s>:\n" before it and " <%s+0x%x>" after the instruction */
+  return OUT_LINE_MAX + 2 * (image->max_name + 22);
 }
 
-static char *get_sb_fmt_operands(uint32_t iw)
+/* Returns the view of the segment that holds @addr, or NULL */
+static const struct image_view *segment_of(uint32_t addr)
 {
-  char *s = malloc(4+2+4+2+5+1);
-  uint8_t rs1, rs2;
-  int16_t imm;
-  rs1 = get_rs1(iw);
-  rs2 = get_rs2(iw);
-
-  imm = (((int32_t)iw >> 19) & ~(0xfff)) |
-        ((iw & (1<<7))<<4) |
-        (((iw >> 25) & 0x3f) << 5) |
-        ((iw >> 7) & 0x1e);
-
-  snprintf(s, 4+2+4+2+5+1, "%s, %s, %d",
-      get_reg_name(rs1), get_reg_name(rs2), imm);
-  return s;
+  const struct image_view *v[2] = { &image->data, &image->text };
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    if (v[i]->bytes && addr >= v[i]->addr && addr - v[i]->addr <= v[i]->size) {
+      return v[i];
+    }
+  }
+  return NULL;
 }
 
-static char *get_jalr_operands(uint32_t iw)
+/* Returns the index of the first label at or above @addr */
+static size_t lower_bound(uint32_t addr)
 {
-  char *s = malloc(4+2+5+6+1);
-  uint8_t rs1, rd;
-  rs1 = get_rs1(iw);
-  rd = get_rd(iw);
+  size_t lo = 0, hi = image->nlabels, mid;
 
-  snprintf(s, 4+2+5+6+1, "%s, %d(%s)",
-      get_reg_name(rd), get_imm(iw), get_reg_name(rs1));
-  return s;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (image->labels[mid].addr < addr) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
 }
 
-static char *get_jal_operands(uint32_t iw)
+/*
+ * Appends " <label+0xoff>" for the address @target, naming the closest label
+ * at or below it in the same segment. Appends nothing if there is none.
+ */
+static char *put_target(char *s, uint32_t target)
 {
-  char *s = malloc(4+2+8+1);
-  uint8_t rd;
-  uint32_t long_imm;
-  rd = get_rd(iw);
-
-  long_imm = (((int32_t)iw >> 12) & ~(0x7ffff)) |
-        (iw & 0xff000) |
-        ((iw & 0x100000) >> 9) |
-        ((iw & 0x7fe00000) >> 20);
-
-  snprintf(s, 4+2+8+1, "%s, %d",
-      get_reg_name(rd), long_imm);
+  const struct image_view *v = segment_of(target);
+  const struct image_label *l;
+  size_t i;
+
+  if (!v) return s;
+  i = lower_bound(target);
+  if (i == image->nlabels || image->labels[i].addr != target) {
+    if (i == 0) return s;
+    /* The first of the labels at the closest address below */
+    i = lower_bound(image->labels[i - 1].addr);
+  }
+  l = &image->labels[i];
+  if (l->addr < v->addr) return s;
+
+  s = put_str(s, " <");
+  s = put_str(s, l->name);
+  if (target != l->addr) {
+    s = put_str(s, "+0x");
+    s = put_hex_trimmed(s, target - l->addr);
+  }
+  *s++ = '>';
   return s;
 }
 
-static char *decode_operands(uint32_t iw)
+/*
+ * Works out the address that the instruction @d at @addr refers to: the
+ * target of a branch or jump, or the address that an auipc or lui before it
+ * builds with it, as la and li do.
+ *
+ * Returns 1 if there is such an address, stored in @target.
+ */
+static int insn_target(const struct decoded_insn *d, uint32_t addr,
+                       const uint32_t *prev_word, uint32_t *target)
 {
-  uint8_t opcode, funct3, funct7;
-  opcode = iw&0x7f;
-  funct3 = (iw>>12)&0x7;
-  funct7 = (iw>>25)&0x7f;
-  char *s;
-
-  switch (opcode) {
-    case 0x3:
-      if (funct3 == 0x2) return get_lw_operands(iw);
-      break;
-
-    case 0x13: /* immediates */
-      switch (funct3) {
-        case 0x1:
-        case 0x5:
-        if (!(funct7 == 0 || funct7 == 0x20)) break;
-        iw = (iw & ~(0xFE000000)); // clear out funct7
-        case 0x0:
-        case 0x2:
-        case 0x4:
-        case 0x6:
-        case 0x7:
-        return get_i_fmt_operands(iw);
+  struct decoded_insn prev;
+
+  switch (d->format) {
+    case FMT_SB:
+    case FMT_UJ:
+      *target = addr + d->imm;
+      return 1;
+    case FMT_I:
+    case FMT_S:
+      if (!prev_word || d->op == INSN_ECALL) return 0;
+      prev = decode_insn(*prev_word);
+      if (prev.rd == 0 || prev.rd != d->rs1) return 0;
+      if (prev.op == INSN_AUIPC) {
+        *target = addr - 4 + prev.imm + d->imm;
+        return 1;
       }
-      break;
-
-    case 0x17:
-      return get_u_fmt_operands(iw);
-
-    case 0x23:
-      if (funct3 == 0x2) return get_s_fmt_operands(iw);
-      break;
-
-    case 0x33:
-      switch (funct3) {
-        case 0x0:
-        case 0x5:
-          if (!(funct7 == 0 || funct7 == 0x20)) break;
-          funct7 = 0;
-        case 0x1:
-        case 0x2:
-        case 0x4:
-        case 0x6:
-        case 0x7:
-          if (!(funct7 == 0)) break;
-          return get_r_fmt_operands(iw);
+      if (prev.op == INSN_LUI) {
+        *target = prev.imm + d->imm;
+        return 1;
       }
-      break;
-
-    case 0x37:
-      return get_u_fmt_operands(iw);
-
-    case 0x63:
-      if (!(funct3 == 0 || funct3 == 1)) break;
-      return get_sb_fmt_operands(iw);
-
-    case 0x67:
-      if (!(funct3 == 0)) break;
-      return get_jalr_operands(iw);
-
-    case 0x6F:
-      return get_jal_operands(iw);
-      break;
-
-    case 0x73:
-      switch (funct3) {
-        case 0x0:
-          if (!(funct7 == 0)) break;
-          return get_i_fmt_operands(iw);
-      }
-      break;
-
-    default:
-      break;
+      return 0;
   }
+  return 0;
+}
 
-  s = (char*)malloc(1);
-  *s = 0;
-  return s;
+/*
+ * Formats the words of @c into its buffer, one line each, with a line for the
+ * label of each address that has one
+ */
+static void format_chunk(struct chunk *c)
+{
+  struct decoded_insn d;
+  char *s = c->buf;
+  uint32_t addr, target;
+  size_t count, l = 0;
+  int i;
+
+  if (image->nlabels) l = lower_bound(c->addr);
+
+  for (count = 0; count < c->nwords; count++) {
+    addr = c->addr + count*4;
+    d = decode_insn(c->words[count]);
+
+    /* "\n%.8X <%s>:\n", for the first label at addr */
+    while (l < image->nlabels && image->labels[l].addr < addr) l++;
+    if (l < image->nlabels && image->labels[l].addr == addr) {
+      *s++ = '\n';
+      s = put_hex(s, addr, 8, 1);
+      s = put_str(s, " <");
+      s = put_str(s, image->labels[l].name);
+      s = put_str(s, ">:\n");
+    }
+
+    /* "%.8X:\t%.2x %.2x %.2x %.2x\t%s\n" */
+    s = put_hex(s, addr, 8, 1);
+    *s++ = ':';
+    *s++ = '\t';
+    for (i = 3; i >= 0; i--) {
+      s = put_hex(s, c->words[count] >> 8*i, 2, 0);
+      *s++ = i ? ' ' : '\t';
+    }
+    s = put_insn(s, &d);
+    if (image->nlabels &&
+        insn_target(&d, addr, addr > c->seg_addr ? &c->words[count - 1] : NULL,
+                    &target)) {
+      s = put_target(s, target);
+    }
+    *s++ = '\n';
+  }
+  c->len = s - c->buf;
 }
 
-/* Decode feature is not fully implemented */
-char *decode(uint32_t word) {
-  uint8_t opcode, funct3, funct7;
-  char *s;
-  size_t bytes = 0;
-  char *mnemonic;
-  char *operands;
+static void *pool_worker(void *arg)
+{
+  struct pool *p = arg;
+  int i;
 
-  opcode = word&0x7f;
-  funct3 = (word>>12)&0x7;
-  funct7 = (word>>25)&0x7f;
+  while ((i = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED)) < p->nchunks) {
+    format_chunk(&p->chunks[i]);
+  }
+  return NULL;
+}
 
-  mnemonic = decode_operation(opcode, funct3, funct7);
-  bytes += strnlen(mnemonic, 8);
+/* Formats the @nchunks @chunks, using up to nthreads threads */
+static void run_pool(struct chunk *chunks, int nchunks)
+{
+  struct pool p = { chunks, nchunks, 0 };
+  pthread_t threads[MAX_THREADS];
+  int i, started = 0;
+
+  /* The calling thread is part of the pool, so none have to start at all */
+  for (i = 1; i < nthreads && i < nchunks; i++) {
+    if (pthread_create(&threads[started], NULL, pool_worker, &p) != 0) break;
+    started++;
+  }
+  pool_worker(&p);
+  for (i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
 
-  operands = decode_operands(word);
-  bytes += strnlen(operands, 30);
+/*
+ * Decoding is stateless, so the segment is cut into chunks that are formatted
+ * in parallel, a batch of one chunk per thread at a time. Each batch is
+ * written out in order before the next one starts, which bounds the memory
+ * used to one buffer per thread.
+ */
+static void print_segment(char *name, const struct image_view *v,
+                          int reversed)
+{
+  struct chunk chunks[MAX_THREADS];
+  const uint32_t *words = (const uint32_t *)v->bytes;
+  uint32_t *copy = NULL, tail = 0;
+  size_t nwords = v->size / 4, done = 0, j;
+  int nchunks = (nwords + CHUNK_WORDS - 1) / CHUNK_WORDS;
+  int nslots = nchunks < nthreads ? nchunks : nthreads;
+  int i, n;
+
+  printf("%s\n", name);
+
+  /* Words are read in place, unless a foreign file misaligns them or they
+   * are stored byte-reversed, as sim.c undoes when it loads the image */
+  if ((uintptr_t)words % 4 != 0 || reversed) {
+    copy = malloc(nwords * 4 + 1);
+    assert(copy != NULL);
+    memcpy(copy, v->bytes, nwords * 4);
+    if (reversed) {
+      for (j = 0; j < nwords; j++) copy[j] = __builtin_bswap32(copy[j]);
+    }
+    words = copy;
+  }
+  if (nslots == 0 && v->size % 4) nslots = 1;
+  for (i = 0; i < nslots; i++) {
+    chunks[i].buf = malloc(CHUNK_WORDS * line_max());
+    assert(chunks[i].buf != NULL);
+  }
 
-  s = malloc(bytes);
-  assert(s != NULL);
+  while (done < nwords) {
+    for (n = 0; n < nslots && done < nwords; n++) {
+      chunks[n].addr = v->addr + done*4;
+      chunks[n].seg_addr = v->addr;
+      chunks[n].words = words + done;
+      chunks[n].nwords = nwords - done < CHUNK_WORDS ? nwords - done
+                                                     : CHUNK_WORDS;
+      done += chunks[n].nwords;
+    }
+    run_pool(chunks, n);
+    for (i = 0; i < n; i++) {
+      fwrite(chunks[i].buf, 1, chunks[i].len, stdout);
+    }
+  }
 
-  snprintf(s, bytes+2, "%s %s", mnemonic, operands);
-  free(operands);
+  /* A partial last word is shown zero-padded */
+  if (v->size % 4) {
+    memcpy(&tail, v->bytes + nwords*4, v->size % 4);
+    if (reversed) tail = __builtin_bswap32(tail);
+    chunks[0].addr = v->addr + nwords*4;
+    chunks[0].seg_addr = chunks[0].addr;
+    chunks[0].words = &tail;
+    chunks[0].nwords = 1;
+    format_chunk(&chunks[0]);
+    fwrite(chunks[0].buf, 1, chunks[0].len, stdout);
+  }
 
-  return s;
+  for (i = 0; i < nslots; i++) {
+    free(chunks[i].buf);
+  }
+  free(copy);
+  printf("\n");
 }
 
-
-static void read_and_print(char *infile, size_t data_words, size_t text_words)
+static void print_labels(const struct image *img)
 {
-  size_t count;
-  FILE *in;
-  uint32_t *data = malloc(sizeof(uint32_t)*data_words);
-  uint32_t *text = malloc(sizeof(uint32_t)*text_words);
-
-  assert(data != NULL);
-  assert(text != NULL);
-
-	in = fopen(infile, "r");
-  assert(in);
-
-  count = fread(data, sizeof(uint32_t), data_words, in);
-  assert(count == data_words);
-  count = fread(text, sizeof(uint32_t), text_words, in);
-  assert(count == text_words);
-
-  printf("\n%s:\tfile format cs4200-riscv32\n\n", infile);
-
-  printf(".data\n");
-  for (count = 0; count < data_words; count++) {
-    char *s = decode(data[count]);
-    printf("%.8X:\t%.2x %.2x %.2x %.2x\t%s\n",
-        (uint32_t)(DATA_BEGIN + count*4),
-        data[count] >> 24 & 0xff,
-        data[count] >> 16 & 0xff,
-        data[count] >> 8 & 0xff,
-        data[count] >> 0 & 0xff,
-        s);
-    free(s);
+  size_t i;
+
+  printf("SYMBOL TABLE:\n");
+  for (i = 0; i < img->nlabels; i++) {
+    printf("%.8X\t%s\n", img->labels[i].addr, img->labels[i].name);
   }
   printf("\n");
+}
+
+/* Prints the image in @infile, decoding the segments where they lie */
+static void read_and_print(const char *infile)
+{
+  struct image img;
+  const char *why;
 
-  printf(".text\n");
-  for (count = 0; count < text_words; count++) {
-    char *s = decode(text[count]);
-    printf("%.8X:\t%.2x %.2x %.2x %.2x\t%s\n",
-        (uint32_t)(TEXT_BEGIN + count*4),
-        text[count] >> 24 & 0xff,
-        text[count] >> 16 & 0xff,
-        text[count] >> 8 & 0xff,
-        text[count] >> 0 & 0xff,
-        s);
-    free(s);
+  if (image_open(&img, infile, &why) != 0) {
+    fprintf(stderr, "%s: %s\n", infile, why);
+    exit(1);
   }
-  printf("\n");
+  image = &img;
+
+  printf("\n%s:\tfile format %s\n\n", infile, img.format);
+  if (img.has_entry) printf("entry point: %.8X\n\n", img.entry);
+  if (img.labels) print_labels(&img);
+  if (img.data.bytes) print_segment(".data", &img.data, img.data_reversed);
+  if (img.text.bytes) print_segment(".text", &img.text, 0);
 
-  fclose(in);
+  image_close(&img);
 }
 
 void usage(char *name)
 {
-	printf("Usage: %s [input program]\n\
+	printf("Usage: %s [-j threads] [input program]\n\
 where:\n\
+\t-j sets how many threads format the output (default: one per CPU).\n\
 \t[input program] is a file containing the program in the expected format.\n",
 	 	name);
 	exit(1);
@@ -482,7 +477,23 @@ where:\n\
 
 int main( int argc, char *argv[] )
 {
-	if ( argc < 2 ) usage(argv[0]);
-  read_and_print(argv[1], 1024, 1024);
+  int opt;
+
+  nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  while ((opt = getopt(argc, argv, "j:")) != -1) {
+    switch (opt) {
+      case 'j':
+        nthreads = atoi(optarg);
+        if (nthreads < 1) usage(argv[0]);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (nthreads < 1) nthreads = 1;
+  if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+
+	if ( optind >= argc ) usage(argv[0]);
+  read_and_print(argv[optind]);
 	return 0;
 }
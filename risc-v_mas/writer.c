@@ -26,6 +26,92 @@
  */
 
 #include "writer.h"
+#include "elf32.h"
+#include "mxe.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Private Helpers */
+
+/* A label gathered for the symbol section */
+struct label {
+  uint32_t addr;
+  const char *name;
+};
+
+/* Labels gathered for the symbol section */
+struct symbols {
+  struct label *v;
+  uint32_t n, cap;
+  uint32_t strsz;         /* Bytes of names, with their NULs */
+  int oom;                /* Set if a label could not be added */
+};
+
+static void add_symbol(void *arg, const char *lbl, uint32_t addr)
+{
+  struct symbols *syms = arg;
+
+  if (syms->n == syms->cap) {
+    uint32_t cap = syms->cap ? 2*syms->cap : 64;
+    struct label *v = realloc(syms->v, cap * sizeof(*v));
+    if (!v) {
+      syms->oom = 1;
+      return;
+    }
+    syms->v = v;
+    syms->cap = cap;
+  }
+  syms->v[syms->n].addr = addr;
+  syms->v[syms->n].name = lbl;
+  syms->n++;
+  syms->strsz += strlen(lbl) + 1;
+}
+
+/* Orders labels by address, then by name */
+static int compare_labels(const void *a, const void *b)
+{
+  const struct label *x = a, *y = b;
+
+  if (x->addr != y->addr) return x->addr < y->addr ? -1 : 1;
+  return strcmp(x->name, y->name);
+}
+
+/**
+ * Gathers the labels of @symtab into @syms, ordered by address and then
+ * name. Returns 0 on success, or -1 if out of memory.
+ */
+static int collect_symbols(const struct symtab *symtab, struct symbols *syms)
+{
+  symtab_foreach(symtab, add_symbol, syms);
+  if (syms->oom) return -1;
+  qsort(syms->v, syms->n, sizeof(struct label), compare_labels);
+  return 0;
+}
+
+/* Pads a section of @size bytes with zeros to a multiple of 4 */
+static size_t write_padding(FILE *out, uint32_t size)
+{
+  static const uint8_t zeros[4];
+
+  return size % 4 ? fwrite(zeros, 1, 4 - size % 4, out) : 0;
+}
+
+/* Writes @n zero bytes, to move a section to its aligned offset */
+static size_t write_zeros(FILE *out, size_t n)
+{
+  static const uint8_t zeros[256];
+  size_t count = 0, chunk;
+
+  while (count < n) {
+    chunk = n - count < sizeof(zeros) ? n - count : sizeof(zeros);
+    if (fwrite(zeros, 1, chunk, out) != chunk) break;
+    count += chunk;
+  }
+  return count;
+}
+
+/* Public Interface */
 
 ssize_t write_program(char *outfile, uint32_t *text, uint32_t *data)
 {
@@ -51,3 +137,227 @@ ssize_t write_program(char *outfile, uint32_t *text, uint32_t *data)
   return count;
 }
 
+
+ssize_t write_mxe(char *outfile, uint32_t entry, const struct segment *data,
+                  const struct segment *text, const struct symtab *symtab)
+{
+  struct symbols syms = {0};
+  struct mxe_header hdr;
+  struct mxe_section sh[4];
+  struct mxe_symbol sym;
+  uint32_t offset, i, name;
+  size_t count, expected;
+  FILE *out;
+
+  if (symtab && collect_symbols(symtab, &syms) != 0) {
+    free(syms.v);
+    return -1;
+  }
+
+  memcpy(hdr.magic, MXE_MAGIC, sizeof(hdr.magic));
+  hdr.version = MXE_VERSION;
+  hdr.nsections = symtab ? 4 : 2;
+  hdr.entry = entry;
+  hdr.shoff = sizeof(hdr);
+
+  sh[0].type = MXE_TEXT;
+  sh[0].addr = text->addr;
+  sh[0].size = text->size;
+  sh[1].type = MXE_DATA;
+  sh[1].addr = data->addr;
+  sh[1].size = data->size;
+  sh[2].type = MXE_SYMTAB;
+  sh[2].addr = 0;
+  sh[2].size = syms.n * sizeof(struct mxe_symbol);
+  sh[3].type = MXE_STRTAB;
+  sh[3].addr = 0;
+  sh[3].size = syms.strsz;
+
+  offset = hdr.shoff + hdr.nsections * sizeof(struct mxe_section);
+  for (i = 0; i < hdr.nsections; i++) {
+    sh[i].offset = offset;
+    offset += (sh[i].size + 3) & ~3;
+  }
+  expected = offset;
+
+  out = fopen(outfile, "w");
+  if (out == NULL) {
+    free(syms.v);
+    return -1;
+  }
+
+  count = fwrite(&hdr, 1, sizeof(hdr), out);
+  count += fwrite(sh, 1, hdr.nsections * sizeof(struct mxe_section), out);
+  count += fwrite(text->bytes, 1, text->size, out);
+  count += write_padding(out, text->size);
+  count += fwrite(data->bytes, 1, data->size, out);
+  count += write_padding(out, data->size);
+  if (symtab) {
+    /* Names are laid out in symbol order */
+    for (i = 0, name = 0; i < syms.n; i++) {
+      sym.addr = syms.v[i].addr;
+      sym.name = name;
+      count += fwrite(&sym, 1, sizeof(sym), out);
+      name += strlen(syms.v[i].name) + 1;
+    }
+    for (i = 0; i < syms.n; i++) {
+      count += fwrite(syms.v[i].name, 1, strlen(syms.v[i].name) + 1, out);
+    }
+    count += write_padding(out, sh[3].size);
+  }
+
+  free(syms.v);
+  if (fclose(out) != 0 || count != expected) return -1;
+  return count;
+}
+
+ssize_t write_elf(char *outfile, uint32_t entry, const struct segment *data,
+                  const struct segment *text, const struct symtab *symtab)
+{
+  static const char shstrtab[] =
+      "\0.text\0.data\0.symtab\0.strtab\0.shstrtab";
+  struct symbols syms = {0};
+  struct elf32_ehdr eh = {0};
+  struct elf32_phdr ph[2] = {{0}};
+  struct elf32_shdr sh[ELF_NSECTIONS] = {{0}};
+  struct elf32_sym sym = {0};
+  uint32_t data_words = (data->size + 3) / 4;
+  uint32_t i, name;
+  uint8_t *bytes = NULL;
+  size_t count = 0, expected;
+  FILE *out;
+
+  if (collect_symbols(symtab, &syms) != 0) {
+    free(syms.v);
+    return -1;
+  }
+
+  /* Data words are kept reversed; put them back in memory order */
+  if (data_words) {
+    bytes = calloc(data_words, 4);
+    if (bytes == NULL) {
+      free(syms.v);
+      return -1;
+    }
+    memcpy(bytes, data->bytes, data->size);
+    for (i = 0; i < data_words; i++) {
+      uint32_t w;
+      memcpy(&w, bytes + 4*i, 4);
+      w = __builtin_bswap32(w);
+      memcpy(bytes + 4*i, &w, 4);
+    }
+  }
+
+  memcpy(eh.ident, ELF_MAGIC, 4);
+  eh.ident[4] = ELF_CLASS32;
+  eh.ident[5] = ELF_DATA2LSB;
+  eh.ident[6] = ELF_VERSION;
+  eh.type = ELF_ET_EXEC;
+  eh.machine = ELF_EM_RISCV;
+  eh.version = ELF_VERSION;
+  eh.entry = entry;
+  eh.phoff = sizeof(eh);
+  eh.ehsize = sizeof(eh);
+  eh.phentsize = sizeof(struct elf32_phdr);
+  eh.phnum = 2;
+  eh.shentsize = sizeof(struct elf32_shdr);
+  eh.shnum = ELF_NSECTIONS;
+  eh.shstrndx = ELF_SEC_SHSTRTAB;
+
+  sh[ELF_SEC_TEXT].name = 1;
+  sh[ELF_SEC_TEXT].type = ELF_SHT_PROGBITS;
+  sh[ELF_SEC_TEXT].flags = ELF_SHF_ALLOC | ELF_SHF_EXECINSTR;
+  sh[ELF_SEC_TEXT].addr = text->addr;
+  sh[ELF_SEC_TEXT].offset = ELF_PAGE_SIZE;
+  sh[ELF_SEC_TEXT].size = text->size;
+  sh[ELF_SEC_TEXT].addralign = 4;
+
+  sh[ELF_SEC_DATA].name = 7;
+  sh[ELF_SEC_DATA].type = ELF_SHT_PROGBITS;
+  sh[ELF_SEC_DATA].flags = ELF_SHF_ALLOC | ELF_SHF_WRITE;
+  sh[ELF_SEC_DATA].addr = data->addr;
+  sh[ELF_SEC_DATA].offset = (ELF_PAGE_SIZE + text->size + ELF_PAGE_SIZE - 1)
+                            & ~(ELF_PAGE_SIZE - 1);
+  sh[ELF_SEC_DATA].size = data->size;
+  sh[ELF_SEC_DATA].addralign = 4;
+
+  /* Entry 0 is the null symbol */
+  sh[ELF_SEC_SYMTAB].name = 13;
+  sh[ELF_SEC_SYMTAB].type = ELF_SHT_SYMTAB;
+  sh[ELF_SEC_SYMTAB].offset = (sh[ELF_SEC_DATA].offset + data->size + 3) & ~3;
+  sh[ELF_SEC_SYMTAB].size = (syms.n + 1) * sizeof(struct elf32_sym);
+  sh[ELF_SEC_SYMTAB].link = ELF_SEC_STRTAB;
+  sh[ELF_SEC_SYMTAB].info = 1;
+  sh[ELF_SEC_SYMTAB].addralign = 4;
+  sh[ELF_SEC_SYMTAB].entsize = sizeof(struct elf32_sym);
+
+  /* Offset 0 is the empty name of the null symbol */
+  sh[ELF_SEC_STRTAB].name = 21;
+  sh[ELF_SEC_STRTAB].type = ELF_SHT_STRTAB;
+  sh[ELF_SEC_STRTAB].offset = sh[ELF_SEC_SYMTAB].offset
+                              + sh[ELF_SEC_SYMTAB].size;
+  sh[ELF_SEC_STRTAB].size = 1 + syms.strsz;
+  sh[ELF_SEC_STRTAB].addralign = 1;
+
+  sh[ELF_SEC_SHSTRTAB].name = 29;
+  sh[ELF_SEC_SHSTRTAB].type = ELF_SHT_STRTAB;
+  sh[ELF_SEC_SHSTRTAB].offset = sh[ELF_SEC_STRTAB].offset
+                                + sh[ELF_SEC_STRTAB].size;
+  sh[ELF_SEC_SHSTRTAB].size = sizeof(shstrtab);
+  sh[ELF_SEC_SHSTRTAB].addralign = 1;
+
+  eh.shoff = (sh[ELF_SEC_SHSTRTAB].offset + sizeof(shstrtab) + 3) & ~3;
+  expected = eh.shoff + sizeof(sh);
+
+  for (i = 0; i < 2; i++) {
+    const struct elf32_shdr *s = &sh[i == 0 ? ELF_SEC_TEXT : ELF_SEC_DATA];
+    ph[i].type = ELF_PT_LOAD;
+    ph[i].offset = s->offset;
+    ph[i].vaddr = ph[i].paddr = s->addr;
+    ph[i].filesz = ph[i].memsz = s->size;
+    ph[i].flags = ELF_PF_R | (i == 0 ? ELF_PF_X : ELF_PF_W);
+    ph[i].align = ELF_PAGE_SIZE;
+  }
+
+  out = fopen(outfile, "w");
+  if (out == NULL) {
+    free(bytes);
+    free(syms.v);
+    return -1;
+  }
+
+  count += fwrite(&eh, 1, sizeof(eh), out);
+  count += fwrite(ph, 1, sizeof(ph), out);
+  count += write_zeros(out, sh[ELF_SEC_TEXT].offset - count);
+  count += fwrite(text->bytes, 1, text->size, out);
+  count += write_zeros(out, sh[ELF_SEC_DATA].offset - count);
+  count += fwrite(bytes, 1, data->size, out);
+  count += write_padding(out, data->size);
+
+  count += fwrite(&sym, 1, sizeof(sym), out);
+  for (i = 0, name = 1; i < syms.n; i++) {
+    int in_text = syms.v[i].addr >= text->addr &&
+                  syms.v[i].addr - text->addr <= text->size;
+    /* An executable has nothing left to bind labels against, so they are
+     * all global, like the exports of a linked program */
+    sym.name = name;
+    sym.value = syms.v[i].addr;
+    sym.info = ELF_ST_INFO(ELF_STB_GLOBAL,
+                           in_text ? ELF_STT_FUNC : ELF_STT_OBJECT);
+    sym.shndx = in_text ? ELF_SEC_TEXT : ELF_SEC_DATA;
+    count += fwrite(&sym, 1, sizeof(sym), out);
+    name += strlen(syms.v[i].name) + 1;
+  }
+  count += fwrite("", 1, 1, out);
+  for (i = 0; i < syms.n; i++) {
+    count += fwrite(syms.v[i].name, 1, strlen(syms.v[i].name) + 1, out);
+  }
+  count += fwrite(shstrtab, 1, sizeof(shstrtab), out);
+  count += write_padding(out, count);
+  count += fwrite(sh, 1, sizeof(sh), out);
+
+  free(bytes);
+  free(syms.v);
+  if (fclose(out) != 0 || count != expected) return -1;
+  return count;
+}
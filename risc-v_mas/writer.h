@@ -28,6 +28,8 @@
 #ifndef WRITER_H_
 #define WRITER_H_
 
+#include "symtab.h"
+
 #include <stdint.h>
 #include <stdio.h>
 
@@ -45,4 +47,31 @@
  */
 ssize_t write_program(char *outfile, uint32_t *text, uint32_t *data);
 
+/* The assembled bytes of a segment and where they are loaded */
+struct segment {
+  const uint8_t *bytes;
+  uint32_t addr;
+  uint32_t size;
+};
+
+/**
+ * Writes to @outfile a sectioned image (see mxe.h) holding the @data and
+ * @text segments, which runs from @entry. If @symtab is not NULL, its labels
+ * are written to a symbol section.
+ *
+ * Returns the number of bytes written, or -1 on error.
+ */
+ssize_t write_mxe(char *outfile, uint32_t entry, const struct segment *data,
+                  const struct segment *text, const struct symtab *symtab);
+
+/**
+ * Writes to @outfile an ELF32 little-endian RISC-V executable (see elf32.h)
+ * that loads the @text and @data segments and runs from @entry. The labels
+ * of @symtab are written to its .symtab section.
+ *
+ * Returns the number of bytes written, or -1 on error.
+ */
+ssize_t write_elf(char *outfile, uint32_t entry, const struct segment *data,
+                  const struct segment *text, const struct symtab *symtab);
+
 #endif /* WRITER_H_ */